@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// The output must have the records of the input, sorted by fieldNo
+void check_sort(const char* input_filename, const Records* input, int fieldNo,
+                const SR_SortOptions* options, int bufferSize) {
+  remove("options_out.db");
+  CALL_OR_DIE(SR_SortedFileWithOptions(input_filename, "options_out.db", fieldNo, bufferSize,
+                                       options));
+  Records output;
+  read_all("options_out.db", &output);
+  CHECK_OR_DIE(output.count == input->count, "wrong number of records");
+  for (int i = 1; i < output.count; i++)
+    CHECK_OR_DIE(field_cmp(&output.records[i - 1], &output.records[i], fieldNo) <= 0,
+                 "records out of order");
+
+  Records expected = { malloc((input->count + 1) * sizeof(Record)), input->count, input->count };
+  CHECK_OR_DIE(expected.records != NULL, "out of memory");
+  memcpy(expected.records, input->records, input->count * sizeof(Record));
+  qsort(expected.records, expected.count, sizeof(Record), all_fields_cmp);
+  qsort(output.records, output.count, sizeof(Record), all_fields_cmp);
+  for (int i = 0; i < output.count; i++)
+    CHECK_OR_DIE(all_fields_cmp(&output.records[i], &expected.records[i]) == 0,
+                 "records that are not in the input");
+
+  free(expected.records);
+  free(output.records);
+}
+
+// Every field with a few buffer sizes (many merge passes, one pass, and
+// an input that fits in the buffer)
+void check_options(const char* description, const SR_SortOptions* options) {
+  const char* inputs[] = { "options_data.db", "options_one.db", "options_empty.db" };
+  const int buffer_sizes[] = { 3, 5, 10, 64 };
+  printf("%s ...", description);
+  for (int f = 0; f < 3; f++) {
+    Records input;
+    read_all(inputs[f], &input);
+    for (int fieldNo = 0; fieldNo <= 3; fieldNo++)
+      for (int b = 0; b < 4; b++)
+        check_sort(inputs[f], &input, fieldNo, options, buffer_sizes[b]);
+    free(input.records);
+  }
+  printf(" ok\n");
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  create_input("options_data.db", 2700, 500);
+  create_input("options_one.db", 1, 500);
+  create_input("options_empty.db", 0, 500);
+
+  SR_SortOptions options;
+  SR_SortOptions_Init(&options);
+  check_options("Default options", &options);
+
+  options.run_generation = SR_RUNS_REPLACEMENT_SELECTION;
+  check_options("Replacement selection", &options);
+
+  // Radix sort is only for the id and multikey quicksort for the strings,
+  // for the other fields they fall back to another sort
+  const SR_GroupSort group_sorts[] = {
+    SR_SORT_IN_PLACE, SR_SORT_KEY_POINTER, SR_SORT_RADIX, SR_SORT_MULTIKEY
+  };
+  const char* group_sort_names[] = {
+    "In place quicksort", "Key/pointer sort", "Radix sort", "Multikey quicksort"
+  };
+  for (int i = 0; i < 4; i++) {
+    SR_SortOptions_Init(&options);
+    options.group_sort = group_sorts[i];
+    check_options(group_sort_names[i], &options);
+  }
+
+  SR_SortOptions_Init(&options);
+  options.normalize_keys = 1;
+  check_options("Normalized keys", &options);
+
+  // With 64 blocks the final merge is also split between the threads
+  SR_SortOptions_Init(&options);
+  options.threads = 4;
+  check_options("Four threads", &options);
+
+  SR_SortOptions_Init(&options);
+  options.read_ahead = 1;
+  options.write_behind = 1;
+  check_options("Read-ahead and write-behind", &options);
+
+  SR_SortOptions_Init(&options);
+  options.run_generation = SR_RUNS_REPLACEMENT_SELECTION;
+  options.read_ahead = 1;
+  options.write_behind = 1;
+  options.normalize_keys = 1;
+  check_options("Replacement selection with every helper", &options);
+
+  SR_SortOptions_Init(&options);
+  options.spill_dir = "./build";
+  check_options("Temp file in ./build", &options);
+
+  // Wrong buffer sizes and thread counts are rejected
+  SR_SortOptions_Init(&options);
+  remove("options_out.db");
+  CHECK_OR_DIE(SR_SortedFileWithOptions("options_data.db", "options_out.db", 0, 2,
+                                        &options) != SR_OK, "two buffer blocks accepted");
+  options.threads = 0;
+  CHECK_OR_DIE(SR_SortedFileWithOptions("options_data.db", "options_out.db", 0, 10,
+                                        &options) != SR_OK, "zero threads accepted");
+
+  BF_Close();
+}
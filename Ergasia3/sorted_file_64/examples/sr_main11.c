@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// Opens the file with SR_OpenFile or with SR_OpenFileMapped and reads its records
+void read_file(const char* filename, int mapped, Records* all) {
+  int fd;
+  if (mapped)
+    CALL_OR_DIE(SR_OpenFileMapped(filename, &fd))
+  else
+    CALL_OR_DIE(SR_OpenFile(filename, &fd))
+  read_records(fd, all);
+  CALL_OR_DIE(SR_CloseFile(fd));
+}
+
+// A mapped file must read the same records as a file opened with SR_OpenFile
+void check_same(const char* filename1, int mapped1, const char* filename2, int mapped2) {
+  Records records1, records2;
+  read_file(filename1, mapped1, &records1);
+  read_file(filename2, mapped2, &records2);
+  CHECK_OR_DIE(records1.count == records2.count, "wrong number of records");
+  for (int i = 0; i < records1.count; i++)
+    CHECK_OR_DIE(memcmp(&records1.records[i], &records2.records[i], sizeof(Record)) == 0,
+                 "different records");
+  free(records1.records);
+  free(records2.records);
+}
+
+void count_record(const Record* record, void* arg) {
+  (*(int*)arg)++;
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  // The same records are inserted into a file opened normally and into a mapped one
+  printf("Insert Entries into a mapped file ...");
+  create_input("mapped_data.db", 2700, 100000);
+  int fd;
+  remove("mapped_insert.db");
+  CALL_OR_DIE(SR_CreateFile("mapped_insert.db"));
+  CALL_OR_DIE(SR_OpenFileMapped("mapped_insert.db", &fd));
+  Records input;
+  read_all("mapped_data.db", &input);
+  for (int i = 0; i < input.count; i++)
+    CALL_OR_DIE(SR_InsertEntry(fd, input.records[i]));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  check_same("mapped_data.db", 0, "mapped_insert.db", 0);
+  printf(" ok\n");
+
+  printf("Read a sorted file mapped ...");
+  remove("mapped_sorted.db");
+  CALL_OR_DIE(SR_SortedFile("mapped_insert.db", "mapped_sorted.db", 2, 10));
+  check_same("mapped_sorted.db", 0, "mapped_sorted.db", 1);
+  printf(" ok\n");
+
+  // The sparse index of the sorted file is also read through the mapping
+  printf("Search a mapped file ...");
+  int fd_mapped;
+  CALL_OR_DIE(SR_OpenFile("mapped_sorted.db", &fd));
+  CALL_OR_DIE(SR_OpenFileMapped("mapped_sorted.db", &fd_mapped));
+  for (int i = 0; i < 10; i++) {
+    Record key;
+    memset(&key, 0, sizeof(Record));
+    strcpy(key.surname, surnames[i]);
+    int count = 0, count_mapped = 0;
+    CALL_OR_DIE(SR_Search(fd, 2, &key, count_record, &count));
+    CALL_OR_DIE(SR_Search(fd_mapped, 2, &key, count_record, &count_mapped));
+    CHECK_OR_DIE(count == count_mapped, "different search results");
+  }
+  CALL_OR_DIE(SR_CloseFile(fd_mapped));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  printf(" ok\n");
+
+  printf("Print all Entries of a mapped file\n");
+  CALL_OR_DIE(SR_OpenFileMapped("mapped_sorted.db", &fd));
+  CALL_OR_DIE(SR_PrintAllEntries(fd));
+  CALL_OR_DIE(SR_CloseFile(fd));
+
+  free(input.records);
+  BF_Close();
+}
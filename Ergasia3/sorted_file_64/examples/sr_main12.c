@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// Only the BF layer of src/bf.c has them
+#pragma weak BF_InitWithConfig
+#pragma weak BF_GetBlockSize
+#pragma weak BF_GetBufferSize
+#pragma weak BF_SetFileHint
+#pragma weak BF_GetFileHint
+
+#define BLOCK_SIZE 4096
+#define BUFFER_SIZE 16
+
+#define CALL_BF_OR_DIE(call)  \
+  {                           \
+    BF_ErrorCode code = call; \
+    if (code != BF_OK) {      \
+      BF_PrintError(code);    \
+      exit(code);             \
+    }                         \
+  }
+
+// The output must have the records of the input, sorted by fieldNo
+void check_sort(const char* description, const Records* input, int fieldNo,
+                const SR_SortOptions* options, int bufferSize) {
+  printf("%s, field %d, %d buffers ...", description, fieldNo, bufferSize);
+  remove("config_out.db");
+  CALL_OR_DIE(SR_SortedFileWithOptions("config_data.db", "config_out.db", fieldNo, bufferSize,
+                                       options));
+  Records output;
+  read_all("config_out.db", &output);
+  CHECK_OR_DIE(output.count == input->count, "wrong number of records");
+  for (int i = 1; i < output.count; i++)
+    CHECK_OR_DIE(field_cmp(&output.records[i - 1], &output.records[i], fieldNo) <= 0,
+                 "records out of order");
+
+  Records expected = { malloc((input->count + 1) * sizeof(Record)), input->count, input->count };
+  CHECK_OR_DIE(expected.records != NULL, "out of memory");
+  memcpy(expected.records, input->records, input->count * sizeof(Record));
+  qsort(expected.records, expected.count, sizeof(Record), all_fields_cmp);
+  qsort(output.records, output.count, sizeof(Record), all_fields_cmp);
+  for (int i = 0; i < output.count; i++)
+    CHECK_OR_DIE(all_fields_cmp(&output.records[i], &expected.records[i]) == 0,
+                 "records that are not in the input");
+
+  free(expected.records);
+  free(output.records);
+  printf(" ok\n");
+}
+
+// Every hint must be read back as it was set, and a scan must give the
+// hint of the file back when it is done
+void check_hints(const char* filename) {
+  printf("File hints of '%s' ...", filename);
+  const BF_AccessHint hints[] = {
+    BF_HINT_NORMAL, BF_HINT_SEQUENTIAL, BF_HINT_EVICT_FIRST, BF_HINT_KEEP_HOT
+  };
+  int fd;
+  CALL_OR_DIE(SR_OpenFile(filename, &fd));
+  BF_AccessHint hint;
+  CALL_BF_OR_DIE(BF_GetFileHint(fd, &hint));
+  CHECK_OR_DIE(hint == BF_HINT_NORMAL, "a file does not open with BF_HINT_NORMAL");
+  for (int i = 0; i < 4; i++) {
+    CALL_BF_OR_DIE(BF_SetFileHint(fd, hints[i]));
+    CALL_BF_OR_DIE(BF_GetFileHint(fd, &hint));
+    CHECK_OR_DIE(hint == hints[i], "the hint is not the one that was set");
+  }
+
+  Records all;
+  read_records(fd, &all);
+  CALL_BF_OR_DIE(BF_GetFileHint(fd, &hint));
+  CHECK_OR_DIE(hint == BF_HINT_KEEP_HOT, "the scan did not give the hint back");
+  free(all.records);
+  CALL_OR_DIE(SR_CloseFile(fd));
+  printf(" ok\n");
+}
+
+int main() {
+  if (BF_InitWithConfig == NULL || BF_GetBlockSize == NULL || BF_GetBufferSize == NULL ||
+      BF_SetFileHint == NULL || BF_GetFileHint == NULL) {
+    printf("This example needs the BF layer of src/bf.c (build/libbf.so)\n");
+    return 0;
+  }
+  CALL_BF_OR_DIE(BF_InitWithConfig(CLOCK, BLOCK_SIZE, BUFFER_SIZE));
+  CHECK_OR_DIE(BF_GetBlockSize() == BLOCK_SIZE, "wrong block size");
+  CHECK_OR_DIE(BF_GetBufferSize() == BUFFER_SIZE, "wrong buffer size");
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  // About 60 records fit in a block, so with 3 buffers there are many merge passes
+  create_input("config_data.db", 5000, 100000);
+  Records input;
+  read_all("config_data.db", &input);
+
+  SR_SortOptions options;
+  SR_SortOptions_Init(&options);
+  options.direct_io = 1;
+  for (int fieldNo = 0; fieldNo <= 3; fieldNo++) {
+    check_sort("Direct I/O", &input, fieldNo, &options, 3);
+    check_sort("Direct I/O", &input, fieldNo, &options, BUFFER_SIZE);
+  }
+  options.read_ahead = 1;
+  options.write_behind = 1;
+  check_sort("Direct I/O with read ahead and write behind", &input, 1, &options, 8);
+
+  // The buffer can not be larger than the memory of the BF layer
+  remove("config_out.db");
+  CHECK_OR_DIE(SR_SortedFileWithOptions("config_data.db", "config_out.db", 0, BUFFER_SIZE + 1,
+                                        &options) != SR_OK,
+               "buffer larger than the BF memory accepted");
+
+  check_hints("config_data.db");
+
+  free(input.records);
+  BF_Close();
+}
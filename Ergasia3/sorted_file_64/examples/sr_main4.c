@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// The top k of the input must be the first k records of a full sort (equal
+// records may come in another order, so only the field is compared)
+void check_top_k(const char* input, int fieldNo, int k, int bufferSize) {
+  printf("Top %d of '%s' in field %d ...", k, input, fieldNo);
+  // The output files must not exist
+  remove("top_k.db");
+  remove("top_k_full.db");
+  CALL_OR_DIE(SR_SortedFileTopK(input, "top_k.db", fieldNo, k, bufferSize, NULL));
+  CALL_OR_DIE(SR_SortedFile(input, "top_k_full.db", fieldNo, bufferSize));
+
+  Records top, full;
+  read_all("top_k.db", &top);
+  read_all("top_k_full.db", &full);
+  int expected = (k < full.count) ? k : full.count;
+  CHECK_OR_DIE(top.count == expected, "wrong number of records");
+  for (int i = 0; i < top.count; i++)
+    CHECK_OR_DIE(field_cmp(&top.records[i], &full.records[i], fieldNo) == 0,
+                 "record out of order");
+
+  // The output is a sorted file like the one of SR_SortedFile
+  int fd, sort_field;
+  CALL_OR_DIE(SR_OpenFile("top_k.db", &fd));
+  CALL_OR_DIE(SR_GetSortField(fd, &sort_field));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  CHECK_OR_DIE(sort_field == fieldNo, "wrong sort field");
+
+  free(top.records);
+  free(full.records);
+  printf(" ok\n");
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  create_input("top_k_data.db", 2700, 100000);
+  create_input("top_k_empty.db", 0, 1);
+
+  // K = 0, in memory, more than fits in memory (through the temp file) and more than the input
+  check_top_k("top_k_data.db", 0, 0, 10);
+  check_top_k("top_k_data.db", 0, 100, 10);
+  check_top_k("top_k_data.db", 2, 100, 10);
+  check_top_k("top_k_data.db", 3, 1000, 10);
+  check_top_k("top_k_data.db", 1, 5000, 10);
+  check_top_k("top_k_empty.db", 0, 10, 10);
+
+  // A negative K is an error
+  remove("top_k.db");
+  CHECK_OR_DIE(SR_SortedFileTopK("top_k_data.db", "top_k.db", 0, -1, 10, NULL) != SR_OK,
+               "negative k accepted");
+
+  BF_Close();
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// Number of records of all with the field between the fields of low and high
+// (NULL for no bound), found by a scan of every record
+int count_in_range(const Records* all, int fieldNo, const Record* low, const Record* high) {
+  int count = 0;
+  for (int i = 0; i < all->count; i++)
+    if ((low == NULL || field_cmp(&all->records[i], low, fieldNo) >= 0) &&
+        (high == NULL || field_cmp(&all->records[i], high, fieldNo) <= 0))
+      count++;
+  return count;
+}
+
+// The scan must find the same records as the scan of every record, in file order
+void check_range(int fd, const Records* all, int fieldNo, const Record* low,
+                 const Record* high, int sorted) {
+  Records found = { NULL, 0, 0 };
+  if (low != NULL && high != NULL && field_cmp(low, high, fieldNo) == 0)
+    CALL_OR_DIE(SR_Search(fd, fieldNo, low, collect_record, &found))
+  else
+    CALL_OR_DIE(SR_RangeScan(fd, fieldNo, low, high, collect_record, &found))
+
+  CHECK_OR_DIE(found.count == count_in_range(all, fieldNo, low, high),
+               "wrong number of records");
+  for (int i = 0; i < found.count; i++) {
+    CHECK_OR_DIE(low == NULL || field_cmp(&found.records[i], low, fieldNo) >= 0,
+                 "record below the range");
+    CHECK_OR_DIE(high == NULL || field_cmp(&found.records[i], high, fieldNo) <= 0,
+                 "record above the range");
+    CHECK_OR_DIE(!sorted || i == 0 ||
+                 field_cmp(&found.records[i - 1], &found.records[i], fieldNo) <= 0,
+                 "records out of order");
+  }
+  free(found.records);
+}
+
+Record id_key(int id) {
+  Record record;
+  memset(&record, 0, sizeof(Record));
+  record.id = id;
+  return record;
+}
+
+Record surname_key(const char* surname) {
+  Record record;
+  memset(&record, 0, sizeof(Record));
+  strcpy(record.surname, surname);
+  return record;
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  create_input("range_data.db", 2700, 100000);
+  remove("range_id.db");
+  remove("range_surname.db");
+  CALL_OR_DIE(SR_SortedFile("range_data.db", "range_id.db", 0, 10));
+  CALL_OR_DIE(SR_SortedFile("range_data.db", "range_surname.db", 2, 10));
+
+  Records all;
+  read_all("range_data.db", &all);
+
+  int fd_id, fd_surname, sort_field;
+  CALL_OR_DIE(SR_OpenFile("range_id.db", &fd_id));
+  CALL_OR_DIE(SR_OpenFile("range_surname.db", &fd_surname));
+  CALL_OR_DIE(SR_GetSortField(fd_id, &sort_field));
+  CHECK_OR_DIE(sort_field == 0, "wrong sort field");
+
+  printf("Range scans on id ...");
+  Record low = id_key(20000), high = id_key(30000);
+  check_range(fd_id, &all, 0, &low, &high, 1);
+  check_range(fd_id, &all, 0, NULL, &high, 1);
+  check_range(fd_id, &all, 0, &low, NULL, 1);
+  check_range(fd_id, &all, 0, NULL, NULL, 1);
+  // An empty range, and ranges before and after every id
+  check_range(fd_id, &all, 0, &high, &low, 1);
+  low = id_key(-10);
+  high = id_key(-1);
+  check_range(fd_id, &all, 0, &low, &high, 1);
+  low = id_key(100000);
+  check_range(fd_id, &all, 0, &low, NULL, 1);
+  printf(" ok\n");
+
+  printf("Searches on id ...");
+  // Ids that are in the file (with their duplicates) and ids that may not be
+  for (int i = 0; i < all.count; i += 97) {
+    Record key = all.records[i];
+    check_range(fd_id, &all, 0, &key, &key, 1);
+    key.id++;
+    check_range(fd_id, &all, 0, &key, &key, 1);
+  }
+  printf(" ok\n");
+
+  printf("Range scans and searches on surname ...");
+  low = surname_key("Gaitanis");
+  high = surname_key("Koronis");
+  check_range(fd_surname, &all, 2, &low, &high, 1);
+  low = surname_key("Mailis");
+  check_range(fd_surname, &all, 2, &low, &low, 1);
+  low = surname_key("Papadopoulos");
+  check_range(fd_surname, &all, 2, &low, &low, 1);
+  printf(" ok\n");
+
+  // A file that is not sorted by the field is scanned whole
+  printf("Range scans on fields the files are not sorted by ...");
+  low = id_key(20000);
+  high = id_key(30000);
+  check_range(fd_surname, &all, 0, &low, &high, 0);
+  int fd_data;
+  CALL_OR_DIE(SR_OpenFile("range_data.db", &fd_data));
+  check_range(fd_data, &all, 0, &low, &high, 0);
+  CALL_OR_DIE(SR_CloseFile(fd_data));
+  printf(" ok\n");
+
+  free(all.records);
+  CALL_OR_DIE(SR_CloseFile(fd_id));
+  CALL_OR_DIE(SR_CloseFile(fd_surname));
+  BF_Close();
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// Pairs found by the join
+typedef struct Pairs {
+  int fieldNo;
+  int count;
+  Record last_left;
+} Pairs;
+
+void check_pair(const Record* left, const Record* right, void* arg) {
+  Pairs* pairs = arg;
+  CHECK_OR_DIE(field_cmp(left, right, pairs->fieldNo) == 0, "pair with different keys");
+  CHECK_OR_DIE(pairs->count == 0 || field_cmp(&pairs->last_left, left, pairs->fieldNo) <= 0,
+               "pairs out of order");
+  pairs->last_left = *left;
+  pairs->count++;
+}
+
+// Number of pairs of the join of two files, found by comparing every two records
+int count_pairs(const Records* left, const Records* right, int fieldNo) {
+  int count = 0;
+  for (int i = 0; i < left->count; i++)
+    for (int j = 0; j < right->count; j++)
+      if (field_cmp(&left->records[i], &right->records[j], fieldNo) == 0)
+        count++;
+  return count;
+}
+
+// Joins two sorted files on fieldNo and checks the pairs given to the callback
+// and the ones written to the output file
+void check_join(const char* left_filename, const char* right_filename, int fieldNo) {
+  printf("Join of '%s' and '%s' on field %d ...", left_filename, right_filename, fieldNo);
+  Records left, right;
+  read_all(left_filename, &left);
+  read_all(right_filename, &right);
+  int expected = count_pairs(&left, &right, fieldNo);
+
+  Pairs pairs = { fieldNo, 0 };
+  remove("join_pairs.db");
+  CALL_OR_DIE(SR_MergeJoin(left_filename, right_filename, fieldNo, "join_pairs.db",
+                           check_pair, &pairs));
+  CHECK_OR_DIE(pairs.count == expected, "wrong number of pairs");
+
+  // The output file has the pairs as two consecutive records
+  Records output;
+  read_all("join_pairs.db", &output);
+  CHECK_OR_DIE(output.count == 2 * expected, "wrong number of records in the output");
+  for (int i = 0; i + 1 < output.count; i += 2)
+    CHECK_OR_DIE(field_cmp(&output.records[i], &output.records[i + 1], fieldNo) == 0,
+                 "output pair with different keys");
+
+  // The pairs can also be given only to the callback
+  pairs.count = 0;
+  CALL_OR_DIE(SR_MergeJoin(left_filename, right_filename, fieldNo, NULL, check_pair, &pairs));
+  CHECK_OR_DIE(pairs.count == expected, "wrong number of pairs without an output file");
+
+  free(left.records);
+  free(right.records);
+  free(output.records);
+  printf(" ok (%d pairs)\n", expected);
+}
+
+void sort_input(const char* input, const char* output, int fieldNo) {
+  remove(output);
+  CALL_OR_DIE(SR_SortedFile(input, output, fieldNo, 10));
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  // Few distinct ids, so both files have groups of equal ids
+  create_input("join_left.db", 700, 300);
+  create_input("join_right.db", 500, 300);
+  create_input("join_empty.db", 0, 1);
+  sort_input("join_left.db", "join_left_id.db", 0);
+  sort_input("join_right.db", "join_right_id.db", 0);
+  sort_input("join_left.db", "join_left_city.db", 3);
+  sort_input("join_right.db", "join_right_city.db", 3);
+  sort_input("join_empty.db", "join_empty_id.db", 0);
+
+  check_join("join_left_id.db", "join_right_id.db", 0);
+  // Every city has about 70 left and 50 right records
+  check_join("join_left_city.db", "join_right_city.db", 3);
+  // A file joined with itself
+  check_join("join_left_city.db", "join_left_city.db", 3);
+  // An empty side has no pairs
+  check_join("join_empty_id.db", "join_right_id.db", 0);
+  check_join("join_left_id.db", "join_empty_id.db", 0);
+
+  // The files must be sorted by the field of the join
+  printf("Join of a file that is not sorted by the field ...\n");
+  remove("join_pairs.db");
+  CHECK_OR_DIE(SR_MergeJoin("join_left_id.db", "join_right_city.db", 3, "join_pairs.db",
+                            NULL, NULL) != SR_OK,
+               "join of a file that is not sorted by the field accepted");
+  printf(" ok\n");
+
+  BF_Close();
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// Compares two records by fieldNo and then by every other field
+int record_cmp(const Record* record1, const Record* record2, int fieldNo) {
+  int cmp = field_cmp(record1, record2, fieldNo);
+  for (int i = 0; i <= 3 && cmp == 0; i++)
+    cmp = field_cmp(record1, record2, i);
+  return cmp;
+}
+
+// The output must be sorted by fieldNo, with one record per group of equal
+// records of the input (SR_REDUCE_DISTINCT) or per value of fieldNo
+void check_reduce(const Records* input, int fieldNo, SR_Reduce reduce,
+                  const SR_SortOptions* base_options, int bufferSize) {
+  SR_SortOptions options = *base_options;
+  options.reduce = reduce;
+  remove("reduce_out.db");
+  CALL_OR_DIE(SR_SortedFileWithOptions("reduce_data.db", "reduce_out.db", fieldNo, bufferSize,
+                                       &options));
+  Records output;
+  read_all("reduce_out.db", &output);
+
+  int groups = 0;
+  for (int i = 0; i < output.count; i++) {
+    const Record* record = &output.records[i];
+    if (i > 0) {
+      int cmp = (reduce == SR_REDUCE_DISTINCT)
+                ? record_cmp(&output.records[i - 1], record, fieldNo)
+                : field_cmp(&output.records[i - 1], record, fieldNo);
+      CHECK_OR_DIE(cmp < 0, "records out of order or not reduced");
+    }
+    // The group of the record in the input
+    int count = 0, min_id = -1, max_id = -1, found = 0;
+    for (int j = 0; j < input->count; j++) {
+      const Record* other = &input->records[j];
+      if (field_cmp(record, other, fieldNo) != 0)
+        continue;
+      count++;
+      if (min_id < 0 || other->id < min_id)
+        min_id = other->id;
+      if (other->id > max_id)
+        max_id = other->id;
+      if (record_cmp(record, other, fieldNo) == 0)
+        found = 1;
+    }
+    CHECK_OR_DIE(reduce != SR_REDUCE_COUNT || record->id == count, "wrong count");
+    CHECK_OR_DIE(reduce == SR_REDUCE_COUNT || found, "record that is not in the input");
+    CHECK_OR_DIE(reduce != SR_REDUCE_MIN_ID || record->id == min_id, "wrong minimum id");
+    CHECK_OR_DIE(reduce != SR_REDUCE_MAX_ID || record->id == max_id, "wrong maximum id");
+    groups++;
+  }
+
+  // Every group of the input is in the output
+  int expected = 0;
+  for (int i = 0; i < input->count; i++) {
+    int first = 1;
+    for (int j = 0; j < i && first; j++) {
+      int cmp = (reduce == SR_REDUCE_DISTINCT)
+                ? record_cmp(&input->records[i], &input->records[j], fieldNo)
+                : field_cmp(&input->records[i], &input->records[j], fieldNo);
+      if (cmp == 0)
+        first = 0;
+    }
+    expected += first;
+  }
+  CHECK_OR_DIE(groups == expected, "wrong number of groups");
+  free(output.records);
+}
+
+void check_all_reductions(const Records* input, const SR_SortOptions* options, int bufferSize) {
+  check_reduce(input, 0, SR_REDUCE_DISTINCT, options, bufferSize);
+  check_reduce(input, 2, SR_REDUCE_DISTINCT, options, bufferSize);
+  check_reduce(input, 3, SR_REDUCE_COUNT, options, bufferSize);
+  check_reduce(input, 1, SR_REDUCE_COUNT, options, bufferSize);
+  check_reduce(input, 2, SR_REDUCE_MIN_ID, options, bufferSize);
+  check_reduce(input, 0, SR_REDUCE_MAX_ID, options, bufferSize);
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  // 3000 records, with few distinct ids and every record twice
+  create_input("reduce_data.db", 1500, 50);
+  Records input;
+  read_all("reduce_data.db", &input);
+  int fd;
+  CALL_OR_DIE(SR_OpenFile("reduce_data.db", &fd));
+  CALL_OR_DIE(SR_InsertEntries(fd, input.records, input.count));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  free(input.records);
+  read_all("reduce_data.db", &input);
+
+  SR_SortOptions options;
+  SR_SortOptions_Init(&options);
+  printf("Reductions with the default options ...");
+  check_all_reductions(&input, &options, 10);
+  printf(" ok\n");
+
+  // Three blocks take many merge passes, each one reduces its runs again
+  printf("Reductions with three buffer blocks ...");
+  check_all_reductions(&input, &options, 3);
+  printf(" ok\n");
+
+  printf("Reductions with replacement selection ...");
+  options.run_generation = SR_RUNS_REPLACEMENT_SELECTION;
+  check_all_reductions(&input, &options, 10);
+  printf(" ok\n");
+
+  printf("Reductions with threads and normalized keys ...");
+  SR_SortOptions_Init(&options);
+  options.threads = 3;
+  options.normalize_keys = 1;
+  check_all_reductions(&input, &options, 10);
+  printf(" ok\n");
+
+  // The count is kept in the id, so the records cannot be counted by it
+  remove("reduce_out.db");
+  SR_SortOptions_Init(&options);
+  options.reduce = SR_REDUCE_COUNT;
+  CHECK_OR_DIE(SR_SortedFileWithOptions("reduce_data.db", "reduce_out.db", 0, 10,
+                                        &options) != SR_OK,
+               "count by id accepted");
+
+  free(input.records);
+  BF_Close();
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+int keys_cmp(const Record* record1, const Record* record2, const SR_SortKey* keys,
+             int key_num) {
+  for (int i = 0; i < key_num; i++) {
+    int cmp = field_cmp(record1, record2, keys[i].fieldNo);
+    if (cmp != 0)
+      return keys[i].descending ? -cmp : cmp;
+  }
+  return 0;
+}
+
+// The output must have the records of the input, sorted by the keys
+void check_keys(const Records* input, const SR_SortKey* keys, int key_num,
+                const SR_SortOptions* options, int bufferSize) {
+  remove("keys_out.db");
+  CALL_OR_DIE(SR_SortedFileByKeys("keys_data.db", "keys_out.db", keys, key_num, bufferSize,
+                                  options));
+  Records output;
+  read_all("keys_out.db", &output);
+  CHECK_OR_DIE(output.count == input->count, "wrong number of records");
+  for (int i = 1; i < output.count; i++)
+    CHECK_OR_DIE(keys_cmp(&output.records[i - 1], &output.records[i], keys, key_num) <= 0,
+                 "records out of order");
+
+  Records expected = { malloc(input->count * sizeof(Record)), input->count, input->count };
+  CHECK_OR_DIE(expected.records != NULL || input->count == 0, "out of memory");
+  memcpy(expected.records, input->records, input->count * sizeof(Record));
+  qsort(expected.records, expected.count, sizeof(Record), all_fields_cmp);
+  qsort(output.records, output.count, sizeof(Record), all_fields_cmp);
+  for (int i = 0; i < output.count; i++)
+    CHECK_OR_DIE(all_fields_cmp(&output.records[i], &expected.records[i]) == 0,
+                 "records that are not in the input");
+
+  // The file is sorted by the first key only if it is ascending
+  int fd, sort_field;
+  CALL_OR_DIE(SR_OpenFile("keys_out.db", &fd));
+  CALL_OR_DIE(SR_GetSortField(fd, &sort_field));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  CHECK_OR_DIE(sort_field == (keys[0].descending ? -1 : keys[0].fieldNo), "wrong sort field");
+
+  free(expected.records);
+  free(output.records);
+}
+
+void check_all_keys(const Records* input, const SR_SortOptions* options, int bufferSize) {
+  const SR_SortKey surname_name_id[] = { { 2, 0 }, { 1, 1 }, { 0, 0 } };
+  const SR_SortKey city_id[] = { { 3, 1 }, { 0, 1 } };
+  const SR_SortKey id_desc[] = { { 0, 1 } };
+  const SR_SortKey name[] = { { 1, 0 } };
+  const SR_SortKey all_fields[] = { { 3, 0 }, { 2, 1 }, { 1, 0 }, { 0, 1 } };
+  check_keys(input, surname_name_id, 3, options, bufferSize);
+  check_keys(input, city_id, 2, options, bufferSize);
+  check_keys(input, id_desc, 1, options, bufferSize);
+  check_keys(input, name, 1, options, bufferSize);
+  check_keys(input, all_fields, 4, options, bufferSize);
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  create_input("keys_data.db", 2700, 500);
+  Records input;
+  read_all("keys_data.db", &input);
+
+  SR_SortOptions options;
+  SR_SortOptions_Init(&options);
+  printf("Sorts by keys with the default options ...");
+  check_all_keys(&input, &options, 10);
+  check_all_keys(&input, &options, 3);
+  printf(" ok\n");
+
+  printf("Sorts by keys with the in place quicksort ...");
+  options.group_sort = SR_SORT_IN_PLACE;
+  check_all_keys(&input, &options, 10);
+  printf(" ok\n");
+
+  printf("Sorts by keys with replacement selection ...");
+  SR_SortOptions_Init(&options);
+  options.run_generation = SR_RUNS_REPLACEMENT_SELECTION;
+  check_all_keys(&input, &options, 10);
+  printf(" ok\n");
+
+  printf("Sorts by keys with threads and normalized keys ...");
+  SR_SortOptions_Init(&options);
+  options.threads = 3;
+  options.normalize_keys = 1;
+  check_all_keys(&input, &options, 20);
+  printf(" ok\n");
+
+  // Every field may be a key once, and there are 1 to 4 keys
+  const SR_SortKey repeated[] = { { 2, 0 }, { 2, 1 } };
+  const SR_SortKey too_many[] = { { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 }, { 0, 1 } };
+  remove("keys_out.db");
+  CHECK_OR_DIE(SR_SortedFileByKeys("keys_data.db", "keys_out.db", repeated, 2, 10,
+                                   NULL) != SR_OK, "repeated key accepted");
+  CHECK_OR_DIE(SR_SortedFileByKeys("keys_data.db", "keys_out.db", too_many, 5, 10,
+                                   NULL) != SR_OK, "five keys accepted");
+  CHECK_OR_DIE(SR_SortedFileByKeys("keys_data.db", "keys_out.db", too_many, 0, 10,
+                                   NULL) != SR_OK, "no keys accepted");
+
+  free(input.records);
+  BF_Close();
+}
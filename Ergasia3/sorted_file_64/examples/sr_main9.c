@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+// Fills records with count random records
+void random_records(Record* records, int count) {
+  Record record;
+  int r;
+  // The bytes after the '\0' of the strings are not zero
+  memset(&record, 'x', sizeof(Record));
+  for (int i = 0; i < count; ++i) {
+    record.id = i;
+    r = rand() % 10;
+    memcpy(record.name, names[r], strlen(names[r]) + 1);
+    r = rand() % 10;
+    memcpy(record.surname, surnames[r], strlen(surnames[r]) + 1);
+    r = rand() % 10;
+    memcpy(record.city, cities[r], strlen(cities[r]) + 1);
+    records[i] = record;
+  }
+}
+
+int open_new_file(const char* filename) {
+  int fd;
+  remove(filename);
+  CALL_OR_DIE(SR_CreateFile(filename));
+  CALL_OR_DIE(SR_OpenFile(filename, &fd));
+  return fd;
+}
+
+// Zero after the '\0' of every string field
+int is_normalized(const Record* record) {
+  const char* fields[] = { record->name, record->surname, record->city };
+  const size_t sizes[] = { sizeof(record->name), sizeof(record->surname),
+                           sizeof(record->city) };
+  for (int i = 0; i < 3; i++)
+    for (size_t j = strlen(fields[i]); j < sizes[i]; j++)
+      if (fields[i][j] != '\0')
+        return 0;
+  return 1;
+}
+
+// The file must have the count records, in order (the same bytes, or the same
+// strings and zero padding if normalized)
+void check_file(const char* filename, const Record* records, int count, int normalized) {
+  Records all;
+  read_all(filename, &all);
+  CHECK_OR_DIE(all.count == count, "wrong number of records");
+  for (int i = 0; i < count; i++) {
+    const Record* record = &all.records[i];
+    if (normalized) {
+      CHECK_OR_DIE(record->id == records[i].id && strcmp(record->name, records[i].name) == 0 &&
+                   strcmp(record->surname, records[i].surname) == 0 &&
+                   strcmp(record->city, records[i].city) == 0, "wrong record");
+      CHECK_OR_DIE(is_normalized(record), "record not normalized");
+    }
+    else {
+      CHECK_OR_DIE(memcmp(record, &records[i], sizeof(Record)) == 0, "wrong record");
+    }
+  }
+  free(all.records);
+}
+
+int main() {
+  BF_Init(LRU);
+  CALL_OR_DIE(SR_Init());
+  srand(12569874);
+
+  const int count = 2700;
+  Record* records = malloc(count * sizeof(Record));
+  CHECK_OR_DIE(records != NULL, "out of memory");
+  random_records(records, count);
+
+  printf("Insert Entries one at a time ...");
+  int fd = open_new_file("append_single.db");
+  for (int i = 0; i < count; i++)
+    CALL_OR_DIE(SR_InsertEntry(fd, records[i]));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  check_file("append_single.db", records, count, 0);
+  printf(" ok\n");
+
+  // Batches of different sizes start in the middle of the last block, and
+  // single inserts and empty batches may come between them
+  printf("Insert Entries in batches ...");
+  fd = open_new_file("append_batch.db");
+  const int batch_sizes[] = { 0, 1, 5, 17, 100, 3, 0, 250 };
+  int inserted = 0, b = 0;
+  while (inserted < count) {
+    int batch = batch_sizes[b++ % 8];
+    if (batch > count - inserted)
+      batch = count - inserted;
+    CALL_OR_DIE(SR_InsertEntries(fd, records + inserted, batch));
+    inserted += batch;
+    if (inserted < count && b % 3 == 0) {
+      CALL_OR_DIE(SR_InsertEntry(fd, records[inserted]));
+      inserted++;
+    }
+  }
+  CALL_OR_DIE(SR_CloseFile(fd));
+  check_file("append_batch.db", records, count, 0);
+  printf(" ok\n");
+
+  printf("Append with normalization ...");
+  fd = open_new_file("append_normalized.db");
+  SR_Appender appender;
+  CALL_OR_DIE(SR_OpenAppender(fd, &appender));
+  appender.normalize = 1;
+  for (int i = 0; i < count / 2; i++)
+    CALL_OR_DIE(SR_Append(&appender, &records[i]));
+  CALL_OR_DIE(SR_CloseAppender(&appender));
+  // A new appender continues in the last block
+  CALL_OR_DIE(SR_OpenAppender(fd, &appender));
+  appender.normalize = 1;
+  for (int i = count / 2; i < count; i++)
+    CALL_OR_DIE(SR_Append(&appender, &records[i]));
+  CALL_OR_DIE(SR_CloseAppender(&appender));
+  CALL_OR_DIE(SR_CloseFile(fd));
+  check_file("append_normalized.db", records, count, 1);
+  printf(" ok\n");
+
+  // The files are sorted like any other sort file
+  printf("Sorting the appended files ...");
+  remove("append_sorted.db");
+  CALL_OR_DIE(SR_SortedFile("append_batch.db", "append_sorted.db", 0, 10));
+  check_file("append_sorted.db", records, count, 0);
+  printf(" ok\n");
+
+  free(records);
+  BF_Close();
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_test_utils.h"
+
+const char* names[10] = {
+  "Yannis",
+  "Christofos",
+  "Sofia",
+  "Marianna",
+  "Vagelis",
+  "Maria",
+  "Iosif",
+  "Dionisis",
+  "Konstantina",
+  "Theofilos"
+};
+
+const char* surnames[10] = {
+  "Ioannidis",
+  "Svingos",
+  "Karvounari",
+  "Rezkalla",
+  "Nikolopoulos",
+  "Berreta",
+  "Koronis",
+  "Gaitanis",
+  "Oikonomou",
+  "Mailis"
+};
+
+const char* cities[10] = {
+  "Athens",
+  "San Francisco",
+  "Los Angeles",
+  "Amsterdam",
+  "London",
+  "New York",
+  "Tokyo",
+  "Hong Kong",
+  "Munich",
+  "Miami"
+};
+
+void collect_record(const Record* record, void* arg) {
+  Records* all = arg;
+  if (all->count == all->capacity) {
+    all->capacity = (all->capacity > 0) ? 2 * all->capacity : 64;
+    all->records = realloc(all->records, all->capacity * sizeof(Record));
+    CHECK_OR_DIE(all->records != NULL, "out of memory");
+  }
+  all->records[all->count++] = *record;
+}
+
+void read_records(int fd, Records* all) {
+  all->records = NULL;
+  all->count = 0;
+  all->capacity = 0;
+  CALL_OR_DIE(SR_RangeScan(fd, 0, NULL, NULL, collect_record, all));
+}
+
+void read_all(const char* filename, Records* all) {
+  int fd;
+  CALL_OR_DIE(SR_OpenFile(filename, &fd));
+  read_records(fd, all);
+  CALL_OR_DIE(SR_CloseFile(fd));
+}
+
+void create_input(const char* filename, int count, int id_range) {
+  int fd;
+  remove(filename);
+  CALL_OR_DIE(SR_CreateFile(filename));
+  CALL_OR_DIE(SR_OpenFile(filename, &fd));
+
+  Record record;
+  int r;
+  for (int i = 0; i < count; ++i) {
+    record.id = rand() % id_range;
+    r = rand() % 10;
+    memcpy(record.name, names[r], strlen(names[r]) + 1);
+    r = rand() % 10;
+    memcpy(record.surname, surnames[r], strlen(surnames[r]) + 1);
+    r = rand() % 10;
+    memcpy(record.city, cities[r], strlen(cities[r]) + 1);
+
+    CALL_OR_DIE(SR_InsertEntry(fd, record));
+  }
+  CALL_OR_DIE(SR_CloseFile(fd));
+}
+
+int field_cmp(const Record* record1, const Record* record2, int fieldNo) {
+  if (fieldNo == 0)
+    return (record1->id > record2->id) - (record1->id < record2->id);
+  else if (fieldNo == 1)
+    return strcmp(record1->name, record2->name);
+  else if (fieldNo == 2)
+    return strcmp(record1->surname, record2->surname);
+  else
+    return strcmp(record1->city, record2->city);
+}
+
+int all_fields_cmp(const void* record1, const void* record2) {
+  for (int fieldNo = 0; fieldNo <= 3; fieldNo++) {
+    int cmp = field_cmp(record1, record2, fieldNo);
+    if (cmp != 0)
+      return cmp;
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef SR_TEST_UTILS
+#define SR_TEST_UTILS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sort_file.h"
+
+// Helpers shared by the examples that check their results (sr_main4 and after)
+
+extern const char* names[10];
+extern const char* surnames[10];
+extern const char* cities[10];
+
+#define CALL_OR_DIE(call)     \
+  {                           \
+    SR_ErrorCode code = call; \
+    if (code != SR_OK) {      \
+      printf("Error\n");      \
+      exit(code);             \
+    }                         \
+  }
+
+#define CHECK_OR_DIE(cond, msg)     \
+  {                                 \
+    if (!(cond)) {                  \
+      printf("Error: %s\n", msg);   \
+      exit(1);                      \
+    }                               \
+  }
+
+// The records of a file, in file order
+typedef struct Records {
+  Record* records;
+  int count;
+  int capacity;
+} Records;
+
+// SR_RecordCallback that adds the record to the Records arg
+void collect_record(const Record* record, void* arg);
+// Reads every record of an open file
+void read_records(int fd, Records* all);
+// Opens the file with SR_OpenFile and reads every record of it
+void read_all(const char* filename, Records* all);
+
+// Creates a file (removing an old one) with count random records, with ids
+// from 0 to id_range-1
+void create_input(const char* filename, int count, int id_range);
+
+// Compare like strcmp, by one field or by every field in order
+int field_cmp(const Record* record1, const Record* record2, int fieldNo);
+int all_fields_cmp(const void* record1, const void* record2);
+
+#endif /* SR_TEST_UTILS */
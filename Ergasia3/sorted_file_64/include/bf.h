@@ -5,9 +5,11 @@
 extern "C" {
 #endif
 
-#define BF_BLOCK_SIZE 1024    /* Το μέγεθος ενός block σε bytes */
-#define BF_BUFFER_SIZE 64     /* Ο μέγιστος αριθμός block που κρατάμε στην μνήμη */
+#define BF_BLOCK_SIZE 1024    /* Το προκαθορισμένο μέγεθος ενός block σε bytes */
+#define BF_BUFFER_SIZE 64     /* Ο προκαθορισμένος μέγιστος αριθμός block που κρατάμε στην μνήμη */
 #define BF_MAX_OPEN_FILES 100 /* Ο μέγιστος αριθμός ανοικτών αρχείων */
+#define BF_MIN_BLOCK_SIZE 512       /* Τα όρια του μεγέθους block της BF_InitWithConfig */
+#define BF_MAX_BLOCK_SIZE (1 << 20)
 
 typedef enum BF_ErrorCode {
   BF_OK,
@@ -23,9 +25,20 @@ typedef enum BF_ErrorCode {
 
 typedef enum ReplacementAlgorithm {
   LRU,
-  MRU
+  MRU,
+  CLOCK   /* Μόνο στην υλοποίηση src/bf.c (build/libbf.so) */
 } ReplacementAlgorithm;
 
+/*
+ * Πώς θα χρησιμοποιηθούν τα block ενός αρχείου (BF_SetFileHint). Υπάρχει
+ * μόνο στην υλοποίηση src/bf.c.
+ */
+typedef enum BF_AccessHint {
+  BF_HINT_NORMAL,      /* τα block αντικαθίστανται με τον αλγόριθμο του BF_Init */
+  BF_HINT_SEQUENTIAL,  /* σειριακή σάρωση, τα block αντικαθίστανται πριν από όλα τα άλλα */
+  BF_HINT_EVICT_FIRST, /* τα block φεύγουν από τη μνήμη μόλις ξεκαρφιτσωθούν */
+  BF_HINT_KEEP_HOT     /* τα block αντικαθίστανται μόνο αν δεν υπάρχει άλλο */
+} BF_AccessHint;
 
 // Δομή Block
 typedef struct BF_Block BF_Block;
@@ -61,10 +74,31 @@ char* BF_Block_GetData(const BF_Block *block);
 /*
  * Με τη συνάρτηση BF_Init πραγματοποιείται η αρχικοποίηση του επιπέδου BF.
  * Μπορούμε να επιλέξουμε ανάμεσα σε δύο πολιτικές αντικατάστασις Block
- * εκείνης της LRU και εκείνης της MRU.
+ * εκείνης της LRU και εκείνης της MRU (και της CLOCK, στην υλοποίηση του
+ * src/bf.c).
  */
 BF_ErrorCode BF_Init(const ReplacementAlgorithm repl_alg);
 
+/*
+ * Η συνάρτηση BF_InitWithConfig είναι ίδια με την BF_Init, αλλά ορίζει και το
+ * μέγεθος block σε bytes (block_size, δύναμη του 2 από BF_MIN_BLOCK_SIZE έως
+ * BF_MAX_BLOCK_SIZE) και το πλήθος των block που κρατάμε στη μνήμη
+ * (buffer_size). Η BF_Init χρησιμοποιεί τα BF_BLOCK_SIZE και BF_BUFFER_SIZE.
+ * Υπάρχει μόνο στην υλοποίηση src/bf.c (build/libbf.so).
+ */
+BF_ErrorCode BF_InitWithConfig(const ReplacementAlgorithm repl_alg,
+                               const int block_size,
+                               const int buffer_size);
+
+/*
+ * Οι συναρτήσεις BF_GetBlockSize και BF_GetBufferSize επιστρέφουν το μέγεθος
+ * block και το πλήθος των block της μνήμης του ενεργού επιπέδου BF (ή τα
+ * BF_BLOCK_SIZE και BF_BUFFER_SIZE, αν δεν έχει αρχικοποιηθεί). Υπάρχουν μόνο
+ * στην υλοποίηση src/bf.c.
+ */
+int BF_GetBlockSize();
+int BF_GetBufferSize();
+
 /*
  * Η συνάρτηση BF_CreateFile δημιουργεί ένα αρχείο με όνομα filename το
  * οποίο αποτελείται από blocks. Αν το αρχείο υπάρχει ήδη τότε επιστρέφεται
@@ -83,6 +117,41 @@ BF_ErrorCode BF_CreateFile(const char* filename);
  */
 BF_ErrorCode BF_OpenFile(const char* filename, int *file_desc);
 
+/*
+ * Η συνάρτηση BF_OpenFileMapped είναι ίδια με την BF_OpenFile, αλλά το αρχείο
+ * απεικονίζεται στη μνήμη με mmap αντί να περνά από τα block της μνήμης του
+ * επιπέδου BF. Η BF_Block_GetData επιστρέφει δείκτη κατευθείαν μέσα στην
+ * απεικόνιση, οπότε τα block δεν αντιγράφονται και δεν μετρούν στο
+ * buffer_size, ενώ την ανάγνωση εκ των προτέρων και την εγγραφή των
+ * αλλαγμένων σελίδων τις κάνει ο πυρήνας (η BF_CloseFile τις γράφει με
+ * msync). Κατάλληλη για σειριακές σαρώσεις. Το ίδιο αρχείο δεν πρέπει να
+ * είναι ανοιχτό ταυτόχρονα και με τους δύο τρόπους. Υπάρχει μόνο στην
+ * υλοποίηση src/bf.c.
+ */
+BF_ErrorCode BF_OpenFileMapped(const char* filename, int *file_desc);
+
+/*
+ * Η συνάρτηση BF_OpenFileDirect είναι ίδια με την BF_OpenFile, αλλά τα block
+ * του αρχείου γράφονται και διαβάζονται με O_DIRECT, χωρίς να περνούν από
+ * την cache σελίδων του πυρήνα (π.χ. για προσωρινά αρχεία που διαβάζονται
+ * μία φορά). Αν το σύστημα αρχείων δεν υποστηρίζει O_DIRECT, το αρχείο
+ * ανοίγει κανονικά. Υπάρχει μόνο στην υλοποίηση src/bf.c.
+ */
+BF_ErrorCode BF_OpenFileDirect(const char* filename, int *file_desc);
+
+/*
+ * Η συνάρτηση BF_SetFileHint ορίζει πώς θα χρησιμοποιηθούν τα block του
+ * ανοιχτού αρχείου file_desc, ώστε π.χ. μια σειριακή σάρωση ή μια ταξινόμηση
+ * να μη διώχνει από τη μνήμη τα block που χρησιμοποιούν συνέχεια άλλα
+ * αρχεία. Ισχύει για τα block που ξεκαρφιτσώνονται από εκεί και πέρα, και
+ * δίνεται και στον πυρήνα (posix_fadvise/madvise). Ένα αρχείο ανοίγει με
+ * BF_HINT_NORMAL (BF_HINT_SEQUENTIAL με την BF_OpenFileMapped). Η
+ * BF_GetFileHint επιστρέφει την τρέχουσα επιλογή στη μεταβλητή hint.
+ * Υπάρχουν μόνο στην υλοποίηση src/bf.c.
+ */
+BF_ErrorCode BF_SetFileHint(const int file_desc, const BF_AccessHint hint);
+BF_ErrorCode BF_GetFileHint(const int file_desc, BF_AccessHint *hint);
+
 /*
  * Η συνάρτηση BF_CloseFile κλείνει το ανοιχτό αρχείο με αναγνωριστικό αριθμό
  * file_desc. Σε περίπτωση επιτυχίας επιστρέφεται BF_OK ενώ σε περίπτωση
@@ -138,6 +207,34 @@ BF_ErrorCode BF_GetBlock(const int file_desc,
  */
 BF_ErrorCode BF_UnpinBlock(BF_Block *block);
 
+/*
+ * Η συνάρτηση BF_ReadBlocks αντιγράφει τα count συνεχόμενα block του αρχείου
+ * file_desc από το first_block και μετά στα καρφιτσωμένα block blocks[0..count-1]
+ * (π.χ. καινούρια block ενός άλλου αρχείου). Όσα block δεν βρίσκονται στη
+ * μνήμη διαβάζονται με μία διανυσματική ανάγνωση (preadv) ανά συνεχόμενο
+ * τμήμα, αντί για ένα BF_GetBlock ανά block, και δεν καταλαμβάνουν block
+ * της μνήμης του επιπέδου BF. Υπάρχει μόνο στην υλοποίηση src/bf.c.
+ * Δεν καρφιτσώνει τα block του file_desc (δεν υπάρχει BF_GetBlocks): στο
+ * πρώτο μέρος της ταξινόμησης κάθε ομάδα ταξινομείται μέσα στα καινούρια
+ * block του αρχείου προορισμού, οπότε η ανάγνωση γίνεται κατευθείαν σε
+ * αυτά. Με καρφίτσωμα θα χρειάζονταν δύο block της μνήμης ανά block της
+ * ομάδας (ή θα μίκραιναν οι ομάδες στο μισό) και μία επιπλέον αντιγραφή.
+ */
+BF_ErrorCode BF_ReadBlocks(const int file_desc,
+                           const int first_block,
+                           const int count,
+                           BF_Block **blocks);
+
+/*
+ * Η συνάρτηση BF_WriteBlock γράφει αμέσως στον δίσκο τα δεδομένα του block,
+ * που πρέπει να είναι καρφιτσωμένο και να μην αλλάξει μέχρι την
+ * BF_UnpinBlock, οπότε το block δεν ξαναγράφεται όταν αντικατασταθεί.
+ * Χρησιμοποιεί μόνο το block και το αρχείο του, άρα μπορεί να κληθεί από
+ * ένα νήμα ενώ άλλο νήμα καλεί τις υπόλοιπες συναρτήσεις του επιπέδου BF.
+ * Υπάρχει μόνο στην υλοποίηση src/bf.c.
+ */
+BF_ErrorCode BF_WriteBlock(BF_Block *block);
+
 /*
  * Η συνάρτηση BF_PrintError βοηθά στην εκτύπωση των σφαλμάτων που δύναται να
  * υπάρξουν με την κλήση συναρτήσεων του επιπέδου αρχείου block. Εκτυπώνεται
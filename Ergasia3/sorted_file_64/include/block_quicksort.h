@@ -2,8 +2,10 @@
 #define BLOCK_QUICKSORT
 
 // ME TA [] TI PAIZEI??
-void block_quicksort(char** buffer_data, int fieldNo, int low, int high);
-int block_partition(char** buffer_data, int fieldNo, int low, int high);
+void block_quicksort(const RecordAddr* addr, RecordCmp cmp, const void* cmp_ctx,
+                     int low, int high);
+int block_partition(const RecordAddr* addr, RecordCmp cmp, const void* cmp_ctx,
+                    int low, int high);
 
 
 
@@ -0,0 +1,29 @@
+#ifndef GROUP_SORT
+#define GROUP_SORT
+
+/*
+ * In-memory sort of a group of blocks in phase 1 of SR_SortedFile, with
+ * the algorithm picked once per sort and its work arrays allocated once.
+ * Every thread that sorts groups needs its own GroupSorter.
+ */
+typedef struct GroupSorter {
+  SR_GroupSort group_sort; // never SR_SORT_AUTO
+  int fieldNo;
+  RecordCmp cmp;
+  const void* cmp_ctx;     // context of cmp (the KeySpec of a sort by keys)
+  SortKey* keys;           // key arrays and scratch records of the key/pointer sorts
+  SortKey* tmp_keys;
+  Record* scratch;
+  const struct Reducer* reduce;  // reduces every sorted group (NULL for none)
+} GroupSorter;
+
+int group_sorter_init(GroupSorter* sorter, SR_GroupSort group_sort, int fieldNo,
+                      RecordCmp cmp, const void* cmp_ctx, const struct Reducer* reduce,
+                      int max_blocks);
+void group_sorter_destroy(GroupSorter* sorter);
+int group_sorter_sort(GroupSorter* sorter, char** buff_data, int group_blocks);
+
+int group_load(RunReader* reader, int fileDesc, BF_Block** blocks, char** buff_data,
+               int max_blocks, int normalize);
+
+#endif /* GROUP_SORT */
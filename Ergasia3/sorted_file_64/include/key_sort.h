@@ -0,0 +1,20 @@
+#ifndef KEY_SORT
+#define KEY_SORT
+
+/*
+ * Entry of the key/pointer array of a group of blocks. The prefix holds the
+ * first bytes of the sort field normalized so that comparing prefixes as
+ * unsigned integers orders them like the field itself (the whole key for
+ * ids, the first 8 characters for strings).
+ */
+typedef struct SortKey {
+  unsigned long long prefix;
+  Record* record;
+} SortKey;
+
+int key_sort_extract(char** buffer_data, int block_num, int fieldNo, const KeySpec* spec,
+                     SortKey* keys);
+void key_sort(SortKey* keys, int n, int fieldNo, const KeySpec* spec);
+void key_sort_permute(char** buffer_data, int block_num, const SortKey* keys, int n, Record* scratch);
+
+#endif /* KEY_SORT */
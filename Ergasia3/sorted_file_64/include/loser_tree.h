@@ -0,0 +1,29 @@
+#ifndef LOSER_TREE
+#define LOSER_TREE
+
+/*
+ * Tournament (loser) tree used by the k-way merge of SR_SortedFile.
+ * Leaves are the merge inputs, every internal node keeps the input that
+ * lost the match played there and losers[0] keeps the overall winner, so
+ * replacing the winner's record only replays the matches on the path from
+ * its leaf to the root (about log2(k) comparisons).
+ */
+typedef struct LoserTree {
+  int capacity;     // max number of inputs the tree was allocated for
+  int k;            // number of inputs of the current merge
+  int active;       // inputs that still have records
+  RecordCmp cmp;    // comparator of the sort field
+  const void* cmp_ctx;  // and its context
+  int* losers;      // losers[0] is the winner, losers[1..k-1] the internal nodes
+  Record** current; // current record of every input (NULL when exhausted)
+} LoserTree;
+
+int loser_tree_init(LoserTree* tree, int capacity, RecordCmp cmp, const void* cmp_ctx);
+void loser_tree_destroy(LoserTree* tree);
+
+void loser_tree_set_input(LoserTree* tree, int input, Record* record);
+void loser_tree_build(LoserTree* tree, int k);
+int loser_tree_winner(const LoserTree* tree);
+void loser_tree_replace_winner(LoserTree* tree, Record* next);
+
+#endif /* LOSER_TREE */
@@ -0,0 +1,14 @@
+#ifndef MERGE
+#define MERGE
+
+SR_ErrorCode merge_runs(int temp_fileDesc, int base, int half_block_num, const Run* runs,
+                        int k, BF_Block** buff_blocks, char* copies, ReadAhead* ahead,
+                        BF_Block** ahead_blocks, LoserTree* tree, int limit,
+                        BlockWriter* writer);
+
+SR_ErrorCode parallel_merge_runs(int temp_fileDesc, int base, int half_block_num,
+                                 const Run* runs, int k, int threads, RecordCmp cmp,
+                                 const void* cmp_ctx, BF_Block** buff_blocks,
+                                 int output_fileDesc, int first_block, SparseIndex* index);
+
+#endif /* MERGE */
@@ -0,0 +1,8 @@
+#ifndef MERGE_JOIN
+#define MERGE_JOIN
+
+SR_ErrorCode merge_join(int left_fileDesc, int left_end_block, int right_fileDesc,
+                        int right_end_block, RecordCmp cmp, BF_Block** blocks,
+                        BlockWriter* writer, SR_JoinCallback callback, void* arg);
+
+#endif /* MERGE_JOIN */
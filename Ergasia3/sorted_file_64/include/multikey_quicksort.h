@@ -0,0 +1,6 @@
+#ifndef MULTIKEY_QUICKSORT
+#define MULTIKEY_QUICKSORT
+
+void multikey_quicksort(SortKey* keys, int n, int fieldNo);
+
+#endif /* MULTIKEY_QUICKSORT */
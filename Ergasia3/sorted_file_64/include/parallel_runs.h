@@ -0,0 +1,10 @@
+#ifndef PARALLEL_RUNS
+#define PARALLEL_RUNS
+
+SR_ErrorCode parallel_sort_groups(RunReader* input, int temp_fileDesc, int normalize,
+                                  int group_blocks, int threads, SR_GroupSort group_sort,
+                                  int fieldNo, RecordCmp cmp, const void* cmp_ctx,
+                                  const struct Reducer* reduce, BF_Block** buff_blocks,
+                                  RunList* runs);
+
+#endif /* PARALLEL_RUNS */
@@ -0,0 +1,6 @@
+#ifndef RADIX_SORT
+#define RADIX_SORT
+
+void radix_sort_keys(SortKey* keys, SortKey* tmp, int n);
+
+#endif /* RADIX_SORT */
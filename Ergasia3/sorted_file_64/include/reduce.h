@@ -0,0 +1,23 @@
+#ifndef REDUCE
+#define REDUCE
+
+/*
+ * Duplicate elimination and aggregation of a sort (SR_SortOptions.reduce).
+ * Records are equal if the comparator of the sort finds them equal, and
+ * every run keeps one record per group of equal records: phase 1 reduces
+ * every sorted group and replacement selection its output, and every merge
+ * reduces the records it writes (see block_writer_put), so the runs shrink
+ * with every pass. The records of the input are turned into aggregates of
+ * one record with reduce_start before they are reduced for the first time.
+ */
+typedef struct Reducer {
+  SR_Reduce reduce;   // never SR_REDUCE_NONE
+  RecordCmp cmp;
+  const void* cmp_ctx;  // context of cmp
+} Reducer;
+
+void reduce_start(const Reducer* reducer, Record* record);
+void reduce_combine(const Reducer* reducer, Record* acc, const Record* record);
+int reduce_group(const Reducer* reducer, char** buff_data, int block_num);
+
+#endif /* REDUCE */
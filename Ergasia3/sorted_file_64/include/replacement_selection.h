@@ -0,0 +1,9 @@
+#ifndef REPLACEMENT_SELECTION
+#define REPLACEMENT_SELECTION
+
+SR_ErrorCode replacement_selection(int input_fileDesc, int temp_fileDesc, RecordCmp cmp,
+                                   const void* cmp_ctx, int normalize, int bufferSize, BF_Block** buff_blocks,
+                                   WriteBehind* behind, const struct Reducer* reduce,
+                                   RunList* runs);
+
+#endif /* REPLACEMENT_SELECTION */
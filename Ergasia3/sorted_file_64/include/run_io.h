@@ -0,0 +1,118 @@
+#ifndef RUN_IO
+#define RUN_IO
+
+// Block size and buffer blocks of the BF layer (set at BF_InitWithConfig)
+int sr_block_size();
+int sr_buffer_size();
+
+// Number of records that fit in a block of the BF layer after the record counter
+int sr_records_per_block();
+
+/*
+ * A run is a sorted sequence of records. The runs of the temp file are
+ * stored packed (every block holds sr_records_per_block() records except the
+ * last one), so a run is described only by the position of its first
+ * record and the number of its records.
+ */
+typedef struct Run {
+  int first_rec;
+  int rec_num;
+} Run;
+
+typedef struct RunList {
+  Run* runs;
+  int run_num;
+  int capacity;
+} RunList;
+
+void run_list_init(RunList* list);
+int run_list_add(RunList* list, int first_rec, int rec_num);
+void run_list_destroy(RunList* list);
+
+// Helper thread that reads the next block of a set of readers (see run_reader_open_ahead)
+typedef struct ReadAhead ReadAhead;
+
+ReadAhead* read_ahead_create(int max_readers);
+void read_ahead_destroy(ReadAhead* ahead);
+
+/*
+ * Sequential reader of the records of blocks first_block..end_block-1,
+ * starting at record first_slot of the first block. It stops after
+ * rec_num records (or at end_block if rec_num is negative). Only the
+ * block it currently reads is pinned, or none if it reads from a copy.
+ * A reader with read-ahead also keeps its next block pinned.
+ */
+typedef struct RunReader {
+  int fileDesc;
+  BF_Block* block;
+  char* copy;         // private copy of the current block (NULL to keep it pinned)
+  ReadAhead* ahead;   // helper that reads the next block (NULL for none)
+  BF_Block* next;     // handle of the next block
+  int next_requested; // the next block was requested from the helper
+  int next_done;      // the helper served the request (set under its lock)
+  SR_ErrorCode next_result;
+  Record* records;    // records of the pinned block (NULL when exhausted)
+  int block_num;      // number of the pinned block
+  int end_block;      // first block after the run
+  int rec_i;          // current record of the pinned block
+  int recs_in_block;  // records of the pinned block
+  int remaining;      // records left (negative for "until end_block")
+} RunReader;
+
+SR_ErrorCode run_reader_open(RunReader* reader, int fileDesc, BF_Block* block,
+                             int first_block, int end_block, int first_slot, int rec_num);
+SR_ErrorCode run_reader_open_copy(RunReader* reader, int fileDesc, BF_Block* block, char* copy,
+                                  int first_block, int end_block, int first_slot, int rec_num);
+SR_ErrorCode run_reader_open_ahead(RunReader* reader, int fileDesc, BF_Block* block,
+                                   BF_Block* next, ReadAhead* ahead, int first_block,
+                                   int end_block, int first_slot, int rec_num);
+SR_ErrorCode run_reader_next(RunReader* reader);
+SR_ErrorCode run_reader_skip_blocks(RunReader* reader, int blocks);
+SR_ErrorCode run_reader_close(RunReader* reader);
+
+// Current record of the reader, NULL if it has no more records
+static inline Record* run_reader_current(const RunReader* reader) {
+  return reader->records == NULL ? NULL : &reader->records[reader->rec_i];
+}
+
+// Helper thread that writes the full blocks of a writer (see block_writer_open_behind)
+typedef struct WriteBehind WriteBehind;
+
+WriteBehind* write_behind_create();
+void write_behind_destroy(WriteBehind* behind);
+
+/*
+ * Sequential writer that fills blocks with sr_records_per_block() records each,
+ * starting from block first_block. The blocks either exist already or are
+ * allocated at the end of the file (allocate = 1) when they are needed.
+ * A writer with write-behind also has the previous block pinned until
+ * the helper has written it.
+ */
+typedef struct BlockWriter {
+  int fileDesc;
+  BF_Block* block;
+  BF_Block* spare;    // handle of the block being written behind
+  WriteBehind* behind;  // helper that writes the full blocks (NULL for none)
+  char* data;         // data of the pinned block (NULL if none is pinned)
+  int block_num;      // number of the block being filled
+  int rec_num;        // records in the pinned block
+  int recs_per_block; // records of a full block
+  int allocate;
+  int written;        // records written so far
+  struct SparseIndex* index;  // gets the first record of every block (NULL for none)
+  const struct Reducer* reduce;  // combines equal consecutive records (NULL for none)
+  Record pending;     // aggregate of the records put since the last different one
+  int has_pending;
+} BlockWriter;
+
+void block_writer_open(BlockWriter* writer, int fileDesc, BF_Block* block,
+                       int first_block, int allocate);
+void block_writer_open_behind(BlockWriter* writer, int fileDesc, BF_Block* block,
+                              BF_Block* spare, WriteBehind* behind, int first_block,
+                              int allocate);
+SR_ErrorCode block_writer_put(BlockWriter* writer, const Record* record);
+SR_ErrorCode block_writer_end_run(BlockWriter* writer);
+SR_ErrorCode block_writer_close(BlockWriter* writer);
+void block_writer_abort(BlockWriter* writer);
+
+#endif /* RUN_IO */
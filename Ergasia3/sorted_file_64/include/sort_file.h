@@ -23,6 +23,8 @@ SR_ErrorCode SR_Init();
 /*
  * Η συνάρτηση SR_CreateFile χρησιμοποιείται για τη δημιουργία και
  * κατάλληλη αρχικοποίηση ενός άδειου αρχείου ταξινόμησης με όνομα fileName.
+ * Στο πρώτο block του αρχείου καταγράφεται το μέγεθος block του επιπέδου BF,
+ * και η SR_OpenFile δεν ανοίγει το αρχείο αν το επίπεδο BF έχει άλλο μέγεθος.
  * Σε περίπτωση που εκτελεστεί επιτυχώς, επιστρέφεται SR_OK, ενώ σε
  * διαφορετική περίπτωση κάποιος κωδικός λάθους.
  */
@@ -44,6 +46,18 @@ SR_ErrorCode SR_OpenFile(
   int *fileDesc             /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
 	);
 
+/*
+ * Η συνάρτηση SR_OpenFileMapped είναι ίδια με την SR_OpenFile, αλλά ανοίγει
+ * το αρχείο με την BF_OpenFileMapped, ώστε οι σειριακές αναγνώσεις (όπως η
+ * SR_PrintAllEntries σε ένα ταξινομημένο αρχείο) να διαβάζουν τις εγγραφές
+ * κατευθείαν από την cache σελίδων του πυρήνα. Αν το επίπεδο BF δεν έχει
+ * BF_OpenFileMapped, το αρχείο ανοίγει κανονικά.
+ */
+SR_ErrorCode SR_OpenFileMapped(
+	const char *fileName, 		/* όνομα αρχείου */
+  int *fileDesc             /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
+	);
+
 /*
  * Η συνάρτηση SR_CloseFile κλείνει το αρχείο που προσδιορίζεται από τον
  * αναγνωριστικό αριθμό ανοίγματος fileDesc. Σε περίπτωση που εκτελεστεί
@@ -67,6 +81,63 @@ SR_ErrorCode SR_InsertEntry(
 	Record record		/* δομή που προσδιορίζει την εγγραφή */
 	);
 
+/*
+ * Ανοιχτή εισαγωγή στο τέλος ενός αρχείου ταξινόμησης. Κρατά καρφωμένο
+ * (pinned) το τελευταίο block του αρχείου, ώστε κάθε εγγραφή να αντιγράφεται
+ * κατευθείαν σε αυτό και το επίπεδο διαχείρισης μπλοκ να χρησιμοποιείται μόνο
+ * όταν γεμίζει ένα block. Όσο είναι ανοιχτή δεν πρέπει να γίνονται άλλες
+ * εισαγωγές στο ίδιο αρχείο. Με normalize = 1 οι εγγραφές κανονικοποιούνται:
+ * τα πεδία name, surname και city αποθηκεύονται συμπληρωμένα με μηδενικά
+ * μετά το '\0', αντί για ό,τι περιείχε η δομή record. Η επιλογή αφορά μόνο
+ * τη συγκεκριμένη εισαγωγή (για την ταξινόμηση αρκεί η normalize_keys).
+ */
+typedef struct SR_Appender {
+  int fileDesc;
+  struct BF_Block *block;  /* το τελευταίο block του αρχείου */
+  char *data;              /* τα δεδομένα του, ή NULL αν δεν είναι καρφωμένο */
+  int rec_num;             /* οι εγγραφές του */
+  int normalize;           /* 1: κανονικοποίηση των εγγραφών (αρχικά 0) */
+} SR_Appender;
+
+/*
+ * Η συνάρτηση SR_OpenAppender ετοιμάζει την appender για εισαγωγές στο
+ * τέλος του ανοιχτού αρχείου fileDesc. Σε περίπτωση που εκτελεστεί επιτυχώς,
+ * επιστρέφεται SR_OK, ενώ σε διαφορετική περίπτωση κάποιος κωδικός λάθους.
+ */
+SR_ErrorCode SR_OpenAppender(
+  int fileDesc,           /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
+  SR_Appender *appender   /* η εισαγωγή που ανοίγει */
+  );
+
+/*
+ * Η συνάρτηση SR_Append προσθέτει την εγγραφή record στο τέλος του αρχείου
+ * της appender, όπως η SR_InsertEntry (και με κανονικοποίηση, αν έχει
+ * οριστεί normalize = 1), αλλά χωρίς να αντιγράφει τη δομή.
+ */
+SR_ErrorCode SR_Append(
+  SR_Appender *appender,  /* ανοιχτή εισαγωγή */
+  const Record *record    /* η εγγραφή προς εισαγωγή */
+  );
+
+/*
+ * Η συνάρτηση SR_CloseAppender ξεκαρφώνει το τελευταίο block και κλείνει
+ * την appender. Το αρχείο μένει ανοιχτό.
+ */
+SR_ErrorCode SR_CloseAppender(
+  SR_Appender *appender   /* ανοιχτή εισαγωγή */
+  );
+
+/*
+ * Η συνάρτηση SR_InsertEntries εισάγει τις count εγγραφές του πίνακα records
+ * στο τέλος του αρχείου, με την ίδια σειρά. Είναι ισοδύναμη με count κλήσεις
+ * της SR_InsertEntry, αλλά γεμίζει ολόκληρα block κάθε φορά.
+ */
+SR_ErrorCode SR_InsertEntries(
+  int fileDesc,           /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
+  const Record *records,  /* οι εγγραφές προς εισαγωγή */
+  int count               /* το πλήθος τους */
+  );
+
 /*
  * Η συνάρτηση αυτή ταξινομεί ένα BF αρχείο με όνομα input_​fileName ως προς το
  * πεδίο που προσδιορίζεται από το fieldNo χρησιμοποιώντας bufferSize block
@@ -84,8 +155,14 @@ SR_ErrorCode SR_InsertEntry(
  *
  *    * Ο αλγόριθμός θα πρέπει να εκμεταλλεύεται όλα τα block μνήμης που σας
  *      δίνονται από την μεταβλητή bufferSize και μόνον αυτά. Αν αυτά τα block
- *      είναι περισσότερα από BF_BUFFER_SIZE ή μικρότερα από 3 τότε θα
- *      επιστρέφεται κωδικός λάθους.
+ *      είναι περισσότερα από τα block της μνήμης του επιπέδου BF
+ *      (BF_BUFFER_SIZE, ή όσα ορίστηκαν με την BF_InitWithConfig) ή
+ *      μικρότερα από 3 τότε θα επιστρέφεται κωδικός λάθους.
+ *
+ *    * Με την υλοποίηση src/bf.c του επιπέδου BF, τα block της εισόδου, του
+ *      προσωρινού αρχείου και της εξόδου αντικαθίστανται πριν από τα block
+ *      των άλλων ανοιχτών αρχείων (BF_SetFileHint), ώστε η ταξινόμηση να
+ *      μην αδειάζει τη μνήμη τους.
  */
 SR_ErrorCode SR_SortedFile(
   const char* input_filename,   /* όνομα αρχείου προς ταξινόμηση */
@@ -94,15 +171,273 @@ SR_ErrorCode SR_SortedFile(
   int bufferSize            /* Το πλήθος των block μνήμης που έχετε διαθέσιμα */
   );
 
+/*
+ * Ο τρόπος με τον οποίο δημιουργούνται τα αρχικά ταξινομημένα κομμάτια (runs)
+ * στο πρώτο μέρος της εξωτερικής ταξινόμησης.
+ */
+typedef enum SR_RunGeneration {
+  SR_RUNS_LOAD_AND_SORT,          /* bufferSize block κάθε φορά, ταξινόμηση στη μνήμη */
+  SR_RUNS_REPLACEMENT_SELECTION   /* σωρός επιλογής-αντικατάστασης, runs ~2*bufferSize block */
+} SR_RunGeneration;
+
+/*
+ * Ο αλγόριθμος με τον οποίο ταξινομείται στη μνήμη κάθε ομάδα από block στο
+ * πρώτο μέρος (όταν run_generation = SR_RUNS_LOAD_AND_SORT).
+ */
+typedef enum SR_GroupSort {
+  SR_SORT_AUTO,         /* radix sort για το id, multikey quicksort για τα αλφαριθμητικά */
+  SR_SORT_IN_PLACE,     /* quicksort που ανταλλάσσει ολόκληρες εγγραφές μέσα στα block */
+  SR_SORT_KEY_POINTER,  /* ταξινόμηση πίνακα (πρόθεμα κλειδιού, δείκτης εγγραφής) */
+  SR_SORT_RADIX,        /* radix sort του πίνακα κλειδιών (μόνο για το id) */
+  SR_SORT_MULTIKEY      /* multikey quicksort του πίνακα κλειδιών (μόνο για name, surname, city) */
+} SR_GroupSort;
+
+/*
+ * Αναγωγή των ίσων εγγραφών κατά την ταξινόμηση (όταν reduce != SR_REDUCE_NONE).
+ * Κάθε ομάδα εγγραφών με ίση τιμή στο πεδίο ταξινόμησης γίνεται μία εγγραφή.
+ */
+typedef enum SR_Reduce {
+  SR_REDUCE_NONE,       /* καμία αναγωγή */
+  SR_REDUCE_DISTINCT,   /* αφαιρούνται οι εγγραφές που είναι ίδιες σε όλα τα πεδία */
+  SR_REDUCE_COUNT,      /* μία εγγραφή ανά τιμή, με id το πλήθος των εγγραφών της */
+  SR_REDUCE_MIN_ID,     /* η εγγραφή με το μικρότερο id κάθε τιμής */
+  SR_REDUCE_MAX_ID      /* η εγγραφή με το μεγαλύτερο id κάθε τιμής */
+} SR_Reduce;
+
+/*
+ * Επιπλέον επιλογές της SR_SortedFileWithOptions. Πρέπει πάντα να
+ * αρχικοποιούνται με την SR_SortOptions_Init, ώστε τα πεδία που δεν αλλάζουμε
+ * να έχουν τις προκαθορισμένες τιμές.
+ */
+typedef struct SR_SortOptions {
+  SR_RunGeneration run_generation;
+  SR_GroupSort group_sort;
+  int normalize_keys;           /* 1: συμπλήρωση με μηδενικά και σύγκριση SIMD */
+  int threads;                  /* νήματα ταξινόμησης των ομάδων στο πρώτο μέρος */
+  int read_ahead;               /* 1: ανάγνωση του επόμενου block κάθε run στη συγχώνευση */
+  int write_behind;             /* 1: εγγραφή των γεμάτων block εξόδου από βοηθητικό νήμα */
+  const char *spill_dir;        /* κατάλογος του προσωρινού αρχείου (NULL: ο τρέχων) */
+  int direct_io;                /* 1: το προσωρινό αρχείο ανοίγει με O_DIRECT */
+  SR_Reduce reduce;             /* αναγωγή των ίσων εγγραφών */
+} SR_SortOptions;
+
+/*
+ * Η συνάρτηση SR_SortOptions_Init γεμίζει τη δομή options με τις
+ * προκαθορισμένες επιλογές, δηλαδή αυτές που χρησιμοποιεί η SR_SortedFile.
+ */
+void SR_SortOptions_Init(SR_SortOptions *options);
+
+/*
+ * Η συνάρτηση SR_SortedFileWithOptions είναι ίδια με την SR_SortedFile, με τη
+ * διαφορά ότι δέχεται και τις επιλογές options (αν είναι NULL χρησιμοποιούνται
+ * οι προκαθορισμένες). Με run_generation = SR_RUNS_REPLACEMENT_SELECTION οι
+ * εγγραφές του αρχείου εισόδου περνούν από σωρό στη μνήμη και τα runs που
+ * παράγονται είναι κατά μέσο όρο διπλάσια από τη μνήμη (ένα μόνο run αν η
+ * είσοδος είναι σχεδόν ταξινομημένη), άρα χρειάζονται λιγότερα περάσματα
+ * συγχώνευσης. Με group_sort = SR_SORT_KEY_POINTER κάθε ομάδα ταξινομείται
+ * μέσω ενός μικρού πίνακα με τα προθέματα των κλειδιών και δείκτες στις
+ * εγγραφές, και οι εγγραφές μετακινούνται μόνο μία φορά στο τέλος. Το
+ * SR_SORT_RADIX ταξινομεί τον ίδιο πίνακα σε γραμμικό χρόνο χωρίς συγκρίσεις
+ * και χρησιμοποιείται πάντα (SR_SORT_AUTO) όταν fieldNo = 0. Για τα πεδία
+ * name, surname και city το SR_SORT_AUTO χρησιμοποιεί το SR_SORT_MULTIKEY,
+ * που χωρίζει τις εγγραφές ανά χαρακτήρα σε τρία μέρη (μικρότερες, ίσες,
+ * μεγαλύτερες) και έτσι δεν επιβαρύνεται από πολλές ίσες τιμές. Αν ζητηθεί
+ * για λάθος τύπο πεδίου, το SR_SORT_RADIX γίνεται SR_SORT_KEY_POINTER και το
+ * SR_SORT_MULTIKEY γίνεται SR_SORT_RADIX. Με normalize_keys = 1 τα πεδία
+ * name, surname και city κάθε εγγραφής συμπληρώνονται με μηδενικά μετά το
+ * '\0' όταν διαβάζονται στο πρώτο μέρος, ώστε όλες οι συγκρίσεις (και στη
+ * συγχώνευση) να γίνονται σε ολόκληρο το πεδίο με εντολές SIMD αντί για strcmp.
+ * Οι εγγραφές του αρχείου εξόδου είναι τότε επίσης κανονικοποιημένες.
+ * Με threads > 1 (μόνο με SR_RUNS_LOAD_AND_SORT) τα bufferSize-1 block
+ * μοιράζονται σε threads ομάδες των (bufferSize-1)/threads block, που
+ * ταξινομούνται παράλληλα από ισάριθμα νήματα, ενώ το νήμα που κάλεσε τη
+ * συνάρτηση γράφει τις έτοιμες ομάδες και φορτώνει τις επόμενες. Η μνήμη
+ * μένει ίδια, αλλά τα αρχικά runs είναι μικρότερα. Επίσης, αν τα runs της
+ * τελικής συγχώνευσης είναι αρκετά λίγα ώστε κάθε νήμα να έχει ένα block
+ * ανά run και ένα για την έξοδο, η έξοδος χωρίζεται σε συνεχόμενα τμήματα
+ * block και κάθε νήμα συγχωνεύει τις εγγραφές ενός τμήματος.
+ * Με read_ahead = 1 (και bufferSize >= 5) κάθε run της συγχώνευσης έχει δύο
+ * block: όσο συγχωνεύονται οι εγγραφές του ενός, ένα βοηθητικό νήμα διαβάζει
+ * το επόμενο block του run, ώστε η συγχώνευση να μην περιμένει τον δίσκο.
+ * Έτσι συγχωνεύονται το πολύ (bufferSize-1)/2 runs τη φορά.
+ * Με write_behind = 1 (και bufferSize >= 4) η έξοδος των συγχωνεύσεων και
+ * της επιλογής-αντικατάστασης έχει δύο block: όσο γεμίζει το ένα, ένα
+ * βοηθητικό νήμα γράφει το προηγούμενο στον δίσκο με την BF_WriteBlock.
+ * Οι είσοδοι της συγχώνευσης έχουν τότε ένα block λιγότερο. Αν το επίπεδο
+ * διαχείρισης μπλοκ δεν έχει BF_WriteBlock (όπως η έτοιμη βιβλιοθήκη του
+ * lib/), η επιλογή δεν έχει κανένα αποτέλεσμα.
+ * Κάθε ταξινόμηση έχει δικό της προσωρινό αρχείο με μοναδικό όνομα στον
+ * κατάλογο spill_dir (π.χ. σε γρήγορο δίσκο ή tmpfs), που σβήνεται από τον
+ * κατάλογο μόλις ανοίξει, οπότε πολλές ταξινομήσεις μπορούν να τρέχουν
+ * ταυτόχρονα και δεν μένουν αρχεία αν διακοπεί το πρόγραμμα. Με
+ * direct_io = 1 το προσωρινό αρχείο ανοίγει με την BF_OpenFileDirect.
+ * Με reduce != SR_REDUCE_NONE οι ίσες εγγραφές συγχωνεύονται ήδη μέσα σε
+ * κάθε αρχικό run και ξανά σε κάθε πέρασμα συγχώνευσης, οπότε σε πεδία με
+ * λίγες διαφορετικές τιμές τα runs μικραίνουν πολύ από το πρώτο μέρος. Με
+ * SR_REDUCE_DISTINCT το αρχείο εξόδου έχει μία φορά κάθε εγγραφή (οι ίσες
+ * τιμές του fieldNo ταξινομούνται και ως προς τα άλλα πεδία). Με
+ * SR_REDUCE_COUNT, SR_REDUCE_MIN_ID και SR_REDUCE_MAX_ID έχει μία εγγραφή
+ * ανά τιμή του fieldNo: μία από τις εγγραφές της με id το πλήθος τους, ή
+ * αυτή με το μικρότερο ή το μεγαλύτερο id. Το SR_REDUCE_COUNT δεν γίνεται
+ * με fieldNo = 0. Με αναγωγή η είσοδος περνά πάντα από το προσωρινό αρχείο
+ * και η τελική συγχώνευση γίνεται από ένα νήμα.
+ */
+SR_ErrorCode SR_SortedFileWithOptions(
+  const char* input_filename,   /* όνομα αρχείου προς ταξινόμηση */
+  const char* output_filename,  /* όνομα του τελικού ταξινομημένου αρχείου */
+  int fieldNo,                  /* αύξων αριθμός πεδίου προς ταξινόμηση */
+  int bufferSize,               /* Το πλήθος των block μνήμης που έχετε διαθέσιμα */
+  const SR_SortOptions *options /* επιλογές ταξινόμησης (ή NULL) */
+  );
+
+/*
+ * Η συνάρτηση SR_SortedFileTopK είναι ίδια με την SR_SortedFileWithOptions,
+ * αλλά γράφει στο αρχείο εξόδου μόνο τις k πρώτες εγγραφές της ταξινομημένης
+ * σειράς (όλες, αν η είσοδος έχει λιγότερες). Αν οι k εγγραφές χωράνε σε
+ * bufferSize-2 block, η είσοδος διαβάζεται μία φορά μέσα από σωρό με τις k
+ * μικρότερες εγγραφές που έχουν βρεθεί, χωρίς προσωρινό αρχείο και
+ * συγχωνεύσεις. Ο σωρός δεν μεταφέρεται ποτέ στον δίσκο: για μεγαλύτερο k
+ * (k > (bufferSize-2) επί τις εγγραφές ενός block) γίνεται η εξωτερική
+ * ταξινόμηση της SR_SortedFileWithOptions, με όλη την είσοδο γραμμένη σε
+ * runs στο προσωρινό αρχείο, όπου όμως κάθε run κρατά μόνο τις k πρώτες
+ * εγγραφές του, και η τελική συγχώνευση σταματά μετά από k εγγραφές.
+ * Δεν γίνεται με reduce != SR_REDUCE_NONE.
+ */
+SR_ErrorCode SR_SortedFileTopK(
+  const char* input_filename,   /* όνομα αρχείου προς ταξινόμηση */
+  const char* output_filename,  /* όνομα του αρχείου με τις k πρώτες εγγραφές */
+  int fieldNo,                  /* αύξων αριθμός πεδίου προς ταξινόμηση */
+  int k,                        /* πλήθος εγγραφών της εξόδου */
+  int bufferSize,               /* Το πλήθος των block μνήμης που έχετε διαθέσιμα */
+  const SR_SortOptions *options /* επιλογές ταξινόμησης (ή NULL) */
+  );
+
+/*
+ * Ένα κλειδί ταξινόμησης της SR_SortedFileByKeys: το πεδίο (όπως το fieldNo
+ * της SR_SortedFile) και η σειρά του.
+ */
+typedef struct SR_SortKey {
+  int fieldNo;                  /* αύξων αριθμός πεδίου */
+  int descending;               /* 1: φθίνουσα σειρά, 0: αύξουσα */
+} SR_SortKey;
+
+/*
+ * Η συνάρτηση SR_SortedFileByKeys είναι ίδια με την SR_SortedFileWithOptions,
+ * αλλά ταξινομεί ως προς τα key_num (1 έως 4) κλειδιά του πίνακα keys με τη
+ * σειρά που δίνονται: οι εγγραφές με ίσο πρώτο κλειδί ταξινομούνται ως προς το
+ * δεύτερο κ.ο.κ. Κάθε πεδίο επιτρέπεται μία φορά. Τα κλειδιά συνδυάζονται σε
+ * ένα σύνθετο κλειδί, οπότε γίνεται μία μόνο εξωτερική ταξινόμηση και κάθε
+ * ζεύγος εγγραφών συγκρίνεται μία φορά. Στο πρώτο μέρος η ομάδα ταξινομείται
+ * μέσω του πίνακα με τα πρώτα 8 byte του σύνθετου κλειδιού (τα αλφαριθμητικά
+ * συμπληρωμένα με μηδενικά και τα byte των φθινουσών κλειδιών αντεστραμμένα),
+ * δηλαδή με SR_SORT_KEY_POINTER εκτός αν ζητηθεί SR_SORT_IN_PLACE. Με ένα
+ * αύξον κλειδί είναι ίδια με την SR_SortedFileWithOptions. Αν το πρώτο κλειδί
+ * είναι αύξον, το αρχείο εξόδου καταγράφεται ως ταξινομημένο ως προς αυτό
+ * (βλ. SR_GetSortField). Με reduce η αναγωγή γίνεται ανά τιμή όλων των
+ * κλειδιών, και με SR_REDUCE_DISTINCT τα πεδία που δεν είναι κλειδιά
+ * προστίθενται ως αύξοντα κλειδιά.
+ */
+SR_ErrorCode SR_SortedFileByKeys(
+  const char* input_filename,   /* όνομα αρχείου προς ταξινόμηση */
+  const char* output_filename,  /* όνομα του τελικού ταξινομημένου αρχείου */
+  const SR_SortKey *keys,       /* τα κλειδιά ταξινόμησης, με σειρά προτεραιότητας */
+  int key_num,                  /* το πλήθος τους */
+  int bufferSize,               /* Το πλήθος των block μνήμης που έχετε διαθέσιμα */
+  const SR_SortOptions *options /* επιλογές ταξινόμησης (ή NULL) */
+  );
+
 /*
  * Η συνάρτηση SR_PrintAllEntries χρησιμοποιείται για την εκτύπωση όλων των
  * εγγραφών που υπάρχουν στο αρχείο ταξινόμησης. Το fileDesc είναι ο αναγνωριστικός
  * αριθμός ανοίγματος του αρχείου, όπως αυτός έχει επιστραφεί από το επίπεδο
- * διαχείρισης μπλοκ. Σε περίπτωση που εκτελεστεί επιτυχώς, επιστρέφεται SR_OK,
+ * διαχείρισης μπλοκ. Κατά τη σάρωση το αρχείο έχει την επιλογή
+ * BF_HINT_SEQUENTIAL. Σε περίπτωση που εκτελεστεί επιτυχώς, επιστρέφεται SR_OK,
  * ενώ σε διαφορετική περίπτωση κάποιος κωδικός λάθους.
  */
 SR_ErrorCode SR_PrintAllEntries(
   int fileDesc		/* αναγνωριστικός αριθμός ανοίγματος αρχείου */
   );
 
+/*
+ * Η συνάρτηση SR_GetSortField επιστρέφει στο fieldNo το πεδίο ως προς το
+ * οποίο είναι ταξινομημένο το αρχείο fileDesc, ή -1 αν δεν είναι. Το αρχείο
+ * εξόδου των SR_SortedFile, SR_SortedFileWithOptions και SR_SortedFileTopK
+ * (και της SR_SortedFileByKeys με αύξον πρώτο κλειδί) έχει στο πρώτο block
+ * το πεδίο ταξινόμησης και, μετά τα block των εγγραφών, ένα αραιό ευρετήριο
+ * με την τιμή του πεδίου στην πρώτη εγγραφή κάθε block.
+ * Τα block του ευρετηρίου έχουν 0 εγγραφές, οπότε οι σαρώσεις του αρχείου
+ * (π.χ. η SR_PrintAllEntries) τα βλέπουν ως άδεια block. Αν προστεθούν
+ * εγγραφές στο αρχείο μετά την ταξινόμηση, το ευρετήριο δεν χρησιμοποιείται.
+ */
+SR_ErrorCode SR_GetSortField(
+  int fileDesc,           /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
+  int *fieldNo            /* το πεδίο ταξινόμησης, ή -1 */
+  );
+
+/*
+ * Συνάρτηση που καλείται για κάθε εγγραφή που βρίσκει η SR_RangeScan. Η
+ * εγγραφή είναι μέσα σε block του επιπέδου BF και ισχύει μόνο κατά την κλήση.
+ */
+typedef void (*SR_RecordCallback)(const Record *record, void *arg);
+
+/*
+ * Η συνάρτηση SR_RangeScan καλεί την callback (με όρισμα arg) για κάθε
+ * εγγραφή του αρχείου fileDesc της οποίας το πεδίο fieldNo είναι από το
+ * αντίστοιχο πεδίο της low μέχρι και αυτό της high (χωρίς κάτω ή άνω όριο αν
+ * η low ή η high είναι NULL), με τη σειρά του αρχείου. Αν το αρχείο είναι
+ * ταξινομημένο ως προς το fieldNo (SR_GetSortField), το πρώτο block της
+ * περιοχής βρίσκεται με δυαδική αναζήτηση στο αραιό ευρετήριο και η ανάγνωση
+ * σταματά στην πρώτη εγγραφή μετά την high, οπότε διαβάζονται O(log block)
+ * block συν τα block της περιοχής. Αλλιώς διαβάζεται όλο το αρχείο.
+ */
+SR_ErrorCode SR_RangeScan(
+  int fileDesc,                 /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
+  int fieldNo,                  /* αύξων αριθμός πεδίου αναζήτησης */
+  const Record *low,            /* εγγραφή με το κάτω όριο στο πεδίο fieldNo (ή NULL) */
+  const Record *high,           /* εγγραφή με το άνω όριο στο πεδίο fieldNo (ή NULL) */
+  SR_RecordCallback callback,   /* καλείται για κάθε εγγραφή της περιοχής */
+  void *arg                     /* όρισμα της callback */
+  );
+
+/*
+ * Η συνάρτηση SR_Search είναι η SR_RangeScan με low = high = key, δηλαδή
+ * βρίσκει τις εγγραφές με την τιμή του πεδίου fieldNo της key.
+ */
+SR_ErrorCode SR_Search(
+  int fileDesc,                 /* αναγνωριστικός αριθμός ανοίγματος αρχείου */
+  int fieldNo,                  /* αύξων αριθμός πεδίου αναζήτησης */
+  const Record *key,            /* εγγραφή με την τιμή αναζήτησης στο πεδίο fieldNo */
+  SR_RecordCallback callback,   /* καλείται για κάθε εγγραφή που βρίσκεται */
+  void *arg                     /* όρισμα της callback */
+  );
+
+/*
+ * Συνάρτηση που καλείται για κάθε ζεύγος εγγραφών που βρίσκει η
+ * SR_MergeJoin. Οι εγγραφές ισχύουν μόνο κατά την κλήση.
+ */
+typedef void (*SR_JoinCallback)(const Record *left, const Record *right, void *arg);
+
+/*
+ * Η συνάρτηση SR_MergeJoin συνενώνει (join) τα αρχεία left_filename και
+ * right_filename ως προς το πεδίο fieldNo: κάθε εγγραφή του αριστερού αρχείου
+ * συνδυάζεται με κάθε εγγραφή του δεξιού που έχει την ίδια τιμή στο πεδίο.
+ * Τα δύο αρχεία πρέπει να έχουν ταξινομηθεί ως προς το fieldNo με την
+ * SR_SortedFile (βλ. SR_GetSortField), αλλιώς επιστρέφεται κωδικός λάθους.
+ * Τα αρχεία διαβάζονται μία φορά, παράλληλα, και μόνο οι εγγραφές του δεξιού
+ * αρχείου με ίδια τιμή ξαναδιαβάζονται για κάθε επόμενη αριστερή εγγραφή με
+ * την ίδια τιμή. Χρησιμοποιούνται 4 block μνήμης, όσο μεγάλες κι αν είναι οι
+ * ομάδες ίσων τιμών. Κάθε ζεύγος γράφεται στο νέο αρχείο output_filename
+ * ως δύο διαδοχικές εγγραφές (η αριστερή και μετά η δεξιά) και δίνεται στην
+ * callback με όρισμα arg. Ένα από τα output_filename και callback μπορεί να
+ * είναι NULL. Τα ζεύγη βγαίνουν με αύξουσα σειρά του πεδίου.
+ */
+SR_ErrorCode SR_MergeJoin(
+  const char* left_filename,    /* αριστερό αρχείο, ταξινομημένο ως προς fieldNo */
+  const char* right_filename,   /* δεξί αρχείο, ταξινομημένο ως προς fieldNo */
+  int fieldNo,                  /* αύξων αριθμός πεδίου της συνένωσης */
+  const char* output_filename,  /* αρχείο με τα ζεύγη (ή NULL) */
+  SR_JoinCallback callback,     /* καλείται για κάθε ζεύγος (ή NULL) */
+  void *arg                     /* όρισμα της callback */
+  );
+
 #endif // SORT_FILE_H
@@ -0,0 +1,41 @@
+#ifndef SPARSE_INDEX
+#define SPARSE_INDEX
+
+// Position of the index information in the first block of a sort file,
+// after ".sf" and the block size
+#define SF_INDEX_OFFSET 8
+
+/*
+ * Sparse index of a sorted file: the sort field of the first record of every
+ * data block. It is filled in memory while the output of a sort is written
+ * and stored after the data blocks, in blocks whose record counter is 0, so
+ * every scan of the file sees them as empty blocks. The first block of the
+ * file tells where the index starts.
+ */
+typedef struct SparseIndex {
+  int fieldNo;
+  size_t key_offset;  // offset of the field in the Record struct
+  size_t key_size;
+  char* keys;         // key of data block i+1 at keys[i*key_size]
+  int block_num;      // data blocks with a key
+  int capacity;
+} SparseIndex;
+
+void sparse_index_init(SparseIndex* index, int fieldNo);
+void sparse_index_destroy(SparseIndex* index);
+int sparse_index_reserve(SparseIndex* index, int block_num);
+int sparse_index_set(SparseIndex* index, int block, const Record* record);
+SR_ErrorCode sparse_index_write(const SparseIndex* index, int fileDesc, BF_Block* block);
+
+// Index of a file as recorded in its first block
+typedef struct SparseIndexInfo {
+  int fieldNo;        // sort field, -1 if the file has no valid index
+  int first_block;    // first index block, the data blocks are 1 to first_block-1
+  int block_num;      // index blocks
+} SparseIndexInfo;
+
+SR_ErrorCode sparse_index_read_info(int fileDesc, BF_Block* block, SparseIndexInfo* info);
+SR_ErrorCode sparse_index_find(int fileDesc, BF_Block* block, const SparseIndexInfo* info,
+                               const Record* key, int* first_block);
+
+#endif /* SPARSE_INDEX */
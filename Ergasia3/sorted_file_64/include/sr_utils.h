@@ -3,8 +3,58 @@
 
 //#include "sort_file.h"
 
-int record_cmp(int, Record, Record);
+// Compares two records (negative, 0 or positive like strcmp)
+// ctx is the state of the comparator, NULL for the comparators of one field
+typedef int (*RecordCmp)(const Record*, const Record*, const void* ctx);
+
+RecordCmp record_comparator(int fieldNo);
+RecordCmp record_comparator_normalized(int fieldNo);
+
+// fieldNo of a sort by the keys of SR_SortedFileByKeys, the records are
+// compared by record_cmp_keys with the KeySpec of the sort as context
+#define SORT_FIELD_KEYS 4
+
+/*
+ * Keys of a sort by keys. Every sort keeps its own, and passes it along
+ * with record_cmp_keys wherever the comparator goes.
+ */
+typedef struct KeySpec {
+  int key_num;
+  int fields[4];
+  int descending[4];
+  RecordCmp cmps[4];  // comparator of every key field
+} KeySpec;
+
+void key_spec_init(KeySpec* spec, const SR_SortKey* keys, int key_num, int normalized);
+int key_spec_leading_field(const KeySpec* spec);
+int record_cmp_keys(const Record* record1, const Record* record2, const void* spec);
+unsigned long long record_keys_prefix(const Record* record, const KeySpec* spec);
+void record_normalize(Record* record);
 void record_swap(Record*, Record*);
-Record* get_nth_record(char** buffer_data, int n);
+size_t string_field_offset(int fieldNo);
+size_t string_field_size(int fieldNo);
+
+/*
+ * Constant time addressing of the records of a group of blocks in memory.
+ * Built once per group: if every block but the last holds the same number
+ * of records the nth record is found with a division, otherwise a table
+ * with a pointer to every record is kept.
+ */
+typedef struct RecordAddr {
+  char** buffer_data;
+  int recs_per_block;  // records of every block but the last (0 if they differ)
+  Record** table;      // pointer of every record (only if they differ)
+} RecordAddr;
+
+int record_addr_init(RecordAddr* addr, char** buffer_data, int block_num);
+void record_addr_destroy(RecordAddr* addr);
+
+// Returns the nth record of the group
+static inline Record* record_addr_get(const RecordAddr* addr, int n) {
+  if (addr->table != NULL)
+    return addr->table[n];
+  Record* records = (Record*)(addr->buffer_data[n / addr->recs_per_block] + sizeof(int));
+  return &records[n % addr->recs_per_block];
+}
 
 #endif /* SR_UTILS */
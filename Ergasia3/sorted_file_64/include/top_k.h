@@ -0,0 +1,8 @@
+#ifndef TOP_K
+#define TOP_K
+
+SR_ErrorCode top_k(int input_fileDesc, int output_fileDesc, RecordCmp cmp,
+                   const void* cmp_ctx, int normalize, int k, BF_Block** buff_blocks,
+                   SparseIndex* index);
+
+#endif /* TOP_K */
@@ -0,0 +1,777 @@
+#define _GNU_SOURCE  // O_DIRECT
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "bf.h"
+
+/*
+ * Source implementation of the BF layer (bf.h), built as build/libbf.so
+ * and linked instead of the prebuilt lib/libbf.so. Files are plain arrays
+ * of blocks, so with the default sizes (BF_BLOCK_SIZE, BF_BUFFER_SIZE) both
+ * libraries read each other's files. BF_InitWithConfig picks other sizes.
+ *
+ * The buffer has buffer_size frames. A hashed page table finds the
+ * frame of a (file, block) pair in constant time, and blocks move between
+ * frames and the disk with pread/pwrite. Every frame counts its pins, so
+ * the same block may be pinned through several BF_Block handles. Unpinned
+ * frames are kept in the order they were unpinned: LRU evicts the oldest,
+ * MRU the newest, and CLOCK sweeps the frames giving a second chance to
+ * the ones used since the last sweep. Free frames are always used first.
+ *
+ * The access hint of a file (BF_SetFileHint) decides the list its unpinned
+ * frames join. Frames of sequential files are evicted first, oldest first,
+ * and frames of hot files only when no other frame is unpinned, so a scan
+ * does not push out the blocks other files keep using. Frames of
+ * evict-first files are written if needed and freed as soon as they are
+ * unpinned. The replacement algorithm only orders the frames of the
+ * files with the normal hint.
+ *
+ * Files opened with BF_OpenFileMapped skip the frames: the whole file is
+ * mapped with mmap into a range of addresses reserved when it is opened,
+ * so a pinned block is a pointer into the mapping and stays valid while the
+ * file grows. The kernel page cache reads ahead and writes the dirty pages
+ * back, and the mapping is synced when the file is closed. To grow in pages
+ * the file is extended past its last block while it is open and truncated
+ * back to whole blocks when it is closed.
+ *
+ * Like the prebuilt library, the layer is not thread safe.
+ */
+
+#define BF_NONE (-1)
+
+// Alignment of the frames, enough for the O_DIRECT transfers of BF_OpenFileDirect
+#define BF_FRAME_ALIGN 4096
+
+// Most blocks of one vectored read (IOV_MAX of Linux)
+#define BF_IOV_MAX 1024
+
+// Handles of blocks of mapped files, which have no frame
+#define BF_MAPPED (-2)
+
+// Addresses reserved for each mapped file, the largest a mapped file can grow
+#define BF_MAP_RESERVE ((size_t)1 << 36)
+
+typedef struct BF_Frame {
+  int file_desc;        // BF_NONE if the frame is free
+  int block_num;
+  int pin_count;
+  int dirty;
+  int referenced;       // used since the last sweep of the clock hand
+  int list;             // unpinned list of the frame (BF_LIST_*)
+  int hash_next;        // next frame of the same bucket
+  int prev;             // neighbours in the unpinned list, or next in the free list
+  int next;
+  char* data;           // block_size bytes
+} BF_Frame;
+
+struct BF_Block {
+  int file_desc;
+  int block_num;
+  char* data;
+  int dirty;
+  int written;          // written by BF_WriteBlock since it was pinned
+  int frame;            // BF_NONE if the handle has no block pinned
+};
+
+typedef struct BF_File {
+  int os_fd;            // BF_NONE if the slot is free
+  int block_num;        // blocks of the file, including the ones not written yet
+  int mapped;           // opened with BF_OpenFileMapped
+  char* map_base;       // BF_MAP_RESERVE reserved bytes, map_bytes of them mapped
+  size_t map_bytes;     // multiple of the page size
+  int map_pins;         // pinned blocks of a mapped file
+  BF_AccessHint hint;
+} BF_File;
+
+// Unpinned lists, in the order they are used for replacement
+#define BF_LIST_COLD 0      // frames of sequential files
+#define BF_LIST_NORMAL 1
+#define BF_LIST_HOT 2
+#define BF_LISTS 3
+
+static struct {
+  int active;
+  ReplacementAlgorithm repl_alg;
+  int block_size;
+  int buffer_size;
+  BF_Frame* frames;     // buffer_size frames
+  char* frame_data;     // the data of all the frames
+  int* hash;            // hash_size buckets
+  int hash_size;        // power of two, at least twice the frames
+  int free_head;        // free frames
+  int unpinned_head[BF_LISTS];  // unpinned frames, least recently unpinned first
+  int unpinned_tail[BF_LISTS];
+  int clock_hand;
+  BF_File files[BF_MAX_OPEN_FILES];
+} bf;
+
+static const char* bf_messages[] = {
+  "Success",
+  "The max number of open files has been reached",
+  "The file has not been openned",
+  "The Buffer Manager is already in use and can't be reinitialized",
+  "The file is already being used",
+  "BF memory is full",
+  "The block number doesn't exists into the file",
+  "The file can not be closed because there are available pin blocks",
+  "Something unexpected occurred"
+};
+
+static int bf_hash(int file_desc, int block_num) {
+  unsigned int h = (unsigned int)file_desc * 0x9E3779B1u ^ (unsigned int)block_num * 0x85EBCA6Bu;
+  return (int)((h ^ (h >> 16)) & (bf.hash_size - 1));
+}
+
+static int bf_valid_file(int file_desc) {
+  return bf.active && file_desc >= 0 && file_desc < BF_MAX_OPEN_FILES &&
+         bf.files[file_desc].os_fd != BF_NONE;
+}
+
+/////////////// Page table ///////////////
+
+static int hash_find(int file_desc, int block_num) {
+  int i = bf.hash[bf_hash(file_desc, block_num)];
+  while (i != BF_NONE &&
+         (bf.frames[i].file_desc != file_desc || bf.frames[i].block_num != block_num))
+    i = bf.frames[i].hash_next;
+  return i;
+}
+
+static void hash_insert(int i) {
+  int bucket = bf_hash(bf.frames[i].file_desc, bf.frames[i].block_num);
+  bf.frames[i].hash_next = bf.hash[bucket];
+  bf.hash[bucket] = i;
+}
+
+static void hash_remove(int i) {
+  int* link = &bf.hash[bf_hash(bf.frames[i].file_desc, bf.frames[i].block_num)];
+  while (*link != i)
+    link = &bf.frames[*link].hash_next;
+  *link = bf.frames[i].hash_next;
+}
+
+/////////////// Frame lists ///////////////
+
+// Appends the frame to the unpinned list of the hint of its file
+static void unpinned_append(int i) {
+  BF_AccessHint hint = bf.files[bf.frames[i].file_desc].hint;
+  int list = (hint == BF_HINT_KEEP_HOT) ? BF_LIST_HOT :
+             (hint == BF_HINT_NORMAL) ? BF_LIST_NORMAL : BF_LIST_COLD;
+  bf.frames[i].list = list;
+  bf.frames[i].prev = bf.unpinned_tail[list];
+  bf.frames[i].next = BF_NONE;
+  if (bf.unpinned_tail[list] != BF_NONE)
+    bf.frames[bf.unpinned_tail[list]].next = i;
+  else
+    bf.unpinned_head[list] = i;
+  bf.unpinned_tail[list] = i;
+}
+
+static void unpinned_remove(int i) {
+  int list = bf.frames[i].list;
+  if (bf.frames[i].prev != BF_NONE)
+    bf.frames[bf.frames[i].prev].next = bf.frames[i].next;
+  else
+    bf.unpinned_head[list] = bf.frames[i].next;
+  if (bf.frames[i].next != BF_NONE)
+    bf.frames[bf.frames[i].next].prev = bf.frames[i].prev;
+  else
+    bf.unpinned_tail[list] = bf.frames[i].prev;
+}
+
+static void free_push(int i) {
+  bf.frames[i].file_desc = BF_NONE;
+  bf.frames[i].pin_count = 0;
+  bf.frames[i].dirty = 0;
+  bf.frames[i].referenced = 0;
+  bf.frames[i].next = bf.free_head;
+  bf.free_head = i;
+}
+
+/////////////// Disk I/O ///////////////
+
+static BF_ErrorCode frame_write(int i) {
+  BF_Frame* frame = &bf.frames[i];
+  off_t offset = (off_t)frame->block_num * bf.block_size;
+  if (pwrite(bf.files[frame->file_desc].os_fd, frame->data, bf.block_size, offset) != bf.block_size)
+    return BF_ERROR;
+  frame->dirty = 0;
+  return BF_OK;
+}
+
+static BF_ErrorCode frame_read(int i) {
+  BF_Frame* frame = &bf.frames[i];
+  off_t offset = (off_t)frame->block_num * bf.block_size;
+  ssize_t got = pread(bf.files[frame->file_desc].os_fd, frame->data, bf.block_size, offset);
+  if (got < 0)
+    return BF_ERROR;
+  // A block after the end of the file was allocated but never written
+  memset(frame->data + got, 0, bf.block_size - got);
+  return BF_OK;
+}
+
+// Writes the frame if needed and takes it out of the page table and the unpinned list
+static BF_ErrorCode frame_evict(int i) {
+  if (bf.frames[i].dirty && frame_write(i) != BF_OK)
+    return BF_ERROR;
+  hash_remove(i);
+  unpinned_remove(i);
+  bf.frames[i].file_desc = BF_NONE;
+  return BF_OK;
+}
+
+// Picks the frame to replace among the unpinned frames of the normal files
+static int pick_normal_victim() {
+  if (bf.repl_alg == LRU)
+    return bf.unpinned_head[BF_LIST_NORMAL];
+  if (bf.repl_alg == MRU)
+    return bf.unpinned_tail[BF_LIST_NORMAL];
+
+  // CLOCK, two sweeps are enough to find a frame that was not used lately
+  if (bf.unpinned_head[BF_LIST_NORMAL] == BF_NONE)
+    return BF_NONE;
+  for (int step = 0; step < 2*bf.buffer_size; step++) {
+    int i = bf.clock_hand;
+    bf.clock_hand = (bf.clock_hand + 1) % bf.buffer_size;
+    if (bf.frames[i].pin_count > 0 || bf.frames[i].list != BF_LIST_NORMAL)
+      continue;
+    if (!bf.frames[i].referenced)
+      return i;
+    bf.frames[i].referenced = 0;
+  }
+  return bf.unpinned_head[BF_LIST_NORMAL];
+}
+
+// Picks the unpinned frame to replace, BF_NONE if every frame is pinned
+static int pick_victim() {
+  if (bf.unpinned_head[BF_LIST_COLD] != BF_NONE)
+    return bf.unpinned_head[BF_LIST_COLD];
+  int i = pick_normal_victim();
+  if (i != BF_NONE)
+    return i;
+  return bf.unpinned_head[BF_LIST_HOT];
+}
+
+// Finds a frame for a new block (a free one, or else a replaced one)
+static BF_ErrorCode frame_get(int* frame) {
+  int i = bf.free_head;
+  if (i != BF_NONE) {
+    bf.free_head = bf.frames[i].next;
+  }
+  else {
+    i = pick_victim();
+    if (i == BF_NONE)
+      return BF_FULL_MEMORY_ERROR;
+    if (frame_evict(i) != BF_OK)
+      return BF_ERROR;
+  }
+  *frame = i;
+  return BF_OK;
+}
+
+// Pins frame i through the handle
+static void frame_pin(int i, BF_Block* block) {
+  BF_Frame* frame = &bf.frames[i];
+  if (frame->pin_count == 0)
+    unpinned_remove(i);
+  frame->pin_count++;
+  frame->referenced = 1;
+
+  block->file_desc = frame->file_desc;
+  block->block_num = frame->block_num;
+  block->data = frame->data;
+  block->dirty = 0;
+  block->written = 0;
+  block->frame = i;
+}
+
+/////////////// Mapped files ///////////////
+
+static size_t page_round(size_t bytes) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (bytes + page - 1) / page * page;
+}
+
+static int map_advice(BF_AccessHint hint) {
+  if (hint == BF_HINT_SEQUENTIAL)
+    return MADV_SEQUENTIAL;
+  if (hint == BF_HINT_KEEP_HOT)
+    return MADV_WILLNEED;
+  return MADV_NORMAL;
+}
+
+// Maps at least bytes bytes of the file, extending the file if it is shorter
+static BF_ErrorCode map_grow(BF_File* file, size_t bytes) {
+  if (bytes <= file->map_bytes)
+    return BF_OK;
+  if (bytes > BF_MAP_RESERVE)
+    return BF_ERROR;
+  size_t new_bytes = file->map_bytes > 0 ? file->map_bytes : page_round(bytes);
+  while (new_bytes < bytes)
+    new_bytes *= 2;
+  if (new_bytes > BF_MAP_RESERVE)
+    new_bytes = BF_MAP_RESERVE;
+
+  struct stat st;
+  if (fstat(file->os_fd, &st) != 0)
+    return BF_ERROR;
+  if ((size_t)st.st_size < new_bytes && ftruncate(file->os_fd, (off_t)new_bytes) != 0)
+    return BF_ERROR;
+  // Only the new pages are mapped, the old ones keep their addresses
+  char* start = file->map_base + file->map_bytes;
+  size_t length = new_bytes - file->map_bytes;
+  if (mmap(start, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+           file->os_fd, (off_t)file->map_bytes) == MAP_FAILED)
+    return BF_ERROR;
+  madvise(start, length, map_advice(file->hint));
+  file->map_bytes = new_bytes;
+  return BF_OK;
+}
+
+// Syncs and unmaps the file and cuts it back to its blocks
+static BF_ErrorCode map_close(BF_File* file) {
+  BF_ErrorCode ret = BF_OK;
+  size_t bytes = (size_t)file->block_num * bf.block_size;
+  if (bytes > 0 && msync(file->map_base, bytes, MS_SYNC) != 0)
+    ret = BF_ERROR;
+  munmap(file->map_base, BF_MAP_RESERVE);
+  if (ftruncate(file->os_fd, (off_t)bytes) != 0)
+    ret = BF_ERROR;
+  return ret;
+}
+
+static void map_pin(int file_desc, int block_num, BF_Block* block) {
+  BF_File* file = &bf.files[file_desc];
+  file->map_pins++;
+  block->file_desc = file_desc;
+  block->block_num = block_num;
+  block->data = file->map_base + (size_t)block_num * bf.block_size;
+  block->dirty = 0;
+  block->written = 0;
+  block->frame = BF_MAPPED;
+}
+
+/////////////// Blocks ///////////////
+
+void BF_Block_Init(BF_Block **block) {
+  BF_Block* new_block = malloc(sizeof(BF_Block));
+  new_block->file_desc = BF_NONE;
+  new_block->block_num = BF_NONE;
+  new_block->data = NULL;
+  new_block->dirty = 0;
+  new_block->written = 0;
+  new_block->frame = BF_NONE;
+  *block = new_block;
+}
+
+void BF_Block_Destroy(BF_Block **block) {
+  free(*block);
+  *block = NULL;
+}
+
+void BF_Block_SetDirty(BF_Block *block) {
+  block->dirty = 1;
+}
+
+char* BF_Block_GetData(const BF_Block *block) {
+  return block->data;
+}
+
+/////////////// Layer ///////////////
+
+BF_ErrorCode BF_Init(const ReplacementAlgorithm repl_alg) {
+  return BF_InitWithConfig(repl_alg, BF_BLOCK_SIZE, BF_BUFFER_SIZE);
+}
+
+BF_ErrorCode BF_InitWithConfig(const ReplacementAlgorithm repl_alg, const int block_size,
+                               const int buffer_size) {
+  if (bf.active)
+    return BF_ACTIVE_ERROR;
+  // Blocks are a power of two bytes, from BF_MIN_BLOCK_SIZE to BF_MAX_BLOCK_SIZE
+  if (block_size < BF_MIN_BLOCK_SIZE || block_size > BF_MAX_BLOCK_SIZE ||
+      (block_size & (block_size - 1)) != 0 || buffer_size < 1)
+    return BF_ERROR;
+
+  int hash_size = 1;
+  while (hash_size < 2*buffer_size)
+    hash_size *= 2;
+  bf.frames = malloc(buffer_size * sizeof(BF_Frame));
+  bf.frame_data = NULL;
+  if (posix_memalign((void**)&bf.frame_data, BF_FRAME_ALIGN, (size_t)buffer_size * block_size) != 0)
+    bf.frame_data = NULL;
+  bf.hash = malloc(hash_size * sizeof(int));
+  if (bf.frames == NULL || bf.frame_data == NULL || bf.hash == NULL) {
+    free(bf.frames);
+    free(bf.frame_data);
+    free(bf.hash);
+    return BF_ERROR;
+  }
+
+  bf.repl_alg = repl_alg;
+  bf.block_size = block_size;
+  bf.buffer_size = buffer_size;
+  bf.hash_size = hash_size;
+  for (int i = 0; i < hash_size; i++)
+    bf.hash[i] = BF_NONE;
+  bf.free_head = BF_NONE;
+  for (int i = buffer_size - 1; i >= 0; i--) {
+    bf.frames[i].data = bf.frame_data + (size_t)i * block_size;
+    free_push(i);
+  }
+  for (int i = 0; i < BF_LISTS; i++) {
+    bf.unpinned_head[i] = BF_NONE;
+    bf.unpinned_tail[i] = BF_NONE;
+  }
+  bf.clock_hand = 0;
+  for (int i = 0; i < BF_MAX_OPEN_FILES; i++)
+    bf.files[i].os_fd = BF_NONE;
+
+  bf.active = 1;
+  return BF_OK;
+}
+
+BF_ErrorCode BF_CreateFile(const char* filename) {
+  int os_fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (os_fd < 0)
+    return (errno == EEXIST) ? BF_FILE_ALREADY_EXISTS : BF_ERROR;
+  close(os_fd);
+  return BF_OK;
+}
+
+static BF_ErrorCode open_file(const char* filename, int mapped, int direct, int *file_desc) {
+  if (!bf.active)
+    return BF_ERROR;
+  int slot = 0;
+  while (slot < BF_MAX_OPEN_FILES && bf.files[slot].os_fd != BF_NONE)
+    slot++;
+  if (slot == BF_MAX_OPEN_FILES)
+    return BF_OPEN_FILES_LIMIT_ERROR;
+
+  int os_fd = open(filename, O_RDWR | (direct ? O_DIRECT : 0));
+  // Some file systems (tmpfs) do not support O_DIRECT, the page cache is used there
+  if (os_fd < 0 && direct && errno == EINVAL)
+    os_fd = open(filename, O_RDWR);
+  if (os_fd < 0)
+    return BF_ERROR;
+  struct stat st;
+  if (fstat(os_fd, &st) != 0) {
+    close(os_fd);
+    return BF_ERROR;
+  }
+
+  BF_File* file = &bf.files[slot];
+  file->block_num = (int)((st.st_size + bf.block_size - 1) / bf.block_size);
+  file->mapped = mapped;
+  file->map_base = NULL;
+  file->map_bytes = 0;
+  file->map_pins = 0;
+  // Mapped files are meant for scans, so the kernel reads them ahead
+  file->hint = mapped ? BF_HINT_SEQUENTIAL : BF_HINT_NORMAL;
+  if (mapped) {
+    // Reserve the addresses now and map the pages of the file into them
+    file->map_base = mmap(NULL, BF_MAP_RESERVE, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (file->map_base == MAP_FAILED) {
+      close(os_fd);
+      return BF_ERROR;
+    }
+    file->os_fd = os_fd;
+    if (map_grow(file, (size_t)file->block_num * bf.block_size) != BF_OK) {
+      munmap(file->map_base, BF_MAP_RESERVE);
+      close(os_fd);
+      file->os_fd = BF_NONE;
+      return BF_ERROR;
+    }
+  }
+  file->os_fd = os_fd;
+  *file_desc = slot;
+  return BF_OK;
+}
+
+BF_ErrorCode BF_OpenFile(const char* filename, int *file_desc) {
+  return open_file(filename, 0, 0, file_desc);
+}
+
+BF_ErrorCode BF_OpenFileMapped(const char* filename, int *file_desc) {
+  return open_file(filename, 1, 0, file_desc);
+}
+
+BF_ErrorCode BF_OpenFileDirect(const char* filename, int *file_desc) {
+  return open_file(filename, 0, 1, file_desc);
+}
+
+BF_ErrorCode BF_CloseFile(const int file_desc) {
+  if (!bf_valid_file(file_desc))
+    return BF_INVALID_FILE_ERROR;
+  BF_File* file = &bf.files[file_desc];
+  if (file->mapped) {
+    if (file->map_pins > 0)
+      return BF_AVAILABLE_PIN_BLOCKS_ERROR;
+    BF_ErrorCode ret = map_close(file);
+    if (close(file->os_fd) != 0)
+      ret = BF_ERROR;
+    file->os_fd = BF_NONE;
+    return ret;
+  }
+  for (int i = 0; i < bf.buffer_size; i++)
+    if (bf.frames[i].file_desc == file_desc && bf.frames[i].pin_count > 0)
+      return BF_AVAILABLE_PIN_BLOCKS_ERROR;
+
+  // Write back the blocks of the file and free their frames
+  BF_ErrorCode ret = BF_OK;
+  for (int i = 0; i < bf.buffer_size; i++) {
+    if (bf.frames[i].file_desc == file_desc) {
+      if (frame_evict(i) != BF_OK)
+        ret = BF_ERROR;
+      free_push(i);
+    }
+  }
+  if (close(bf.files[file_desc].os_fd) != 0)
+    ret = BF_ERROR;
+  bf.files[file_desc].os_fd = BF_NONE;
+  return ret;
+}
+
+BF_ErrorCode BF_SetFileHint(const int file_desc, const BF_AccessHint hint) {
+  if (!bf_valid_file(file_desc) || hint < BF_HINT_NORMAL || hint > BF_HINT_KEEP_HOT)
+    return BF_ERROR;
+  BF_File* file = &bf.files[file_desc];
+  file->hint = hint;
+  // The page cache of the kernel gets the hint as well
+  if (file->mapped && file->map_bytes > 0)
+    madvise(file->map_base, file->map_bytes, map_advice(hint));
+  int advice = (hint == BF_HINT_SEQUENTIAL) ? POSIX_FADV_SEQUENTIAL :
+               (hint == BF_HINT_EVICT_FIRST) ? POSIX_FADV_NOREUSE : POSIX_FADV_NORMAL;
+  posix_fadvise(file->os_fd, 0, 0, advice);
+  return BF_OK;
+}
+
+BF_ErrorCode BF_GetFileHint(const int file_desc, BF_AccessHint *hint) {
+  if (!bf_valid_file(file_desc))
+    return BF_ERROR;
+  *hint = bf.files[file_desc].hint;
+  return BF_OK;
+}
+
+BF_ErrorCode BF_GetBlockCounter(const int file_desc, int *blocks_num) {
+  if (!bf_valid_file(file_desc))
+    return BF_INVALID_FILE_ERROR;
+  *blocks_num = bf.files[file_desc].block_num;
+  return BF_OK;
+}
+
+BF_ErrorCode BF_AllocateBlock(const int file_desc, BF_Block *block) {
+  if (!bf_valid_file(file_desc))
+    return BF_INVALID_FILE_ERROR;
+
+  BF_File* file = &bf.files[file_desc];
+  if (file->mapped) {
+    if (map_grow(file, (size_t)(file->block_num + 1) * bf.block_size) != BF_OK)
+      return BF_ERROR;
+    map_pin(file_desc, file->block_num++, block);
+    memset(block->data, 0, bf.block_size);
+    return BF_OK;
+  }
+
+  int i;
+  BF_ErrorCode code = frame_get(&i);
+  if (code != BF_OK)
+    return code;
+  // The new block is empty and reaches the disk even if it is never changed
+  BF_Frame* frame = &bf.frames[i];
+  frame->file_desc = file_desc;
+  frame->block_num = bf.files[file_desc].block_num++;
+  frame->pin_count = 0;
+  frame->dirty = 1;
+  memset(frame->data, 0, bf.block_size);
+  hash_insert(i);
+  unpinned_append(i);
+  frame_pin(i, block);
+  return BF_OK;
+}
+
+BF_ErrorCode BF_GetBlock(const int file_desc, const int block_num, BF_Block *block) {
+  if (!bf_valid_file(file_desc))
+    return BF_INVALID_FILE_ERROR;
+  if (block_num < 0 || block_num >= bf.files[file_desc].block_num)
+    return BF_INVALID_BLOCK_NUMBER_ERROR;
+  if (bf.files[file_desc].mapped) {
+    map_pin(file_desc, block_num, block);
+    return BF_OK;
+  }
+
+  int i = hash_find(file_desc, block_num);
+  if (i == BF_NONE) {
+    BF_ErrorCode code = frame_get(&i);
+    if (code != BF_OK)
+      return code;
+    BF_Frame* frame = &bf.frames[i];
+    frame->file_desc = file_desc;
+    frame->block_num = block_num;
+    frame->pin_count = 0;
+    frame->dirty = 0;
+    if (frame_read(i) != BF_OK) {
+      free_push(i);
+      return BF_ERROR;
+    }
+    hash_insert(i);
+    unpinned_append(i);
+  }
+  frame_pin(i, block);
+  return BF_OK;
+}
+
+BF_ErrorCode BF_UnpinBlock(BF_Block *block) {
+  // The pages of a mapped file are written back by the kernel
+  if (block->frame == BF_MAPPED) {
+    if (!bf_valid_file(block->file_desc) || bf.files[block->file_desc].map_pins == 0)
+      return BF_ERROR;
+    bf.files[block->file_desc].map_pins--;
+    block->data = NULL;
+    block->dirty = 0;
+    block->frame = BF_NONE;
+    return BF_OK;
+  }
+
+  int i = block->frame;
+  if (!bf.active || i == BF_NONE || bf.frames[i].file_desc != block->file_desc ||
+      bf.frames[i].block_num != block->block_num || bf.frames[i].pin_count == 0)
+    return BF_ERROR;
+
+  BF_Frame* frame = &bf.frames[i];
+  // A block written through its only pin is clean
+  if (block->written && frame->pin_count == 1)
+    frame->dirty = 0;
+  else
+    frame->dirty |= block->dirty;
+  frame->pin_count--;
+  BF_ErrorCode ret = BF_OK;
+  if (frame->pin_count == 0) {
+    unpinned_append(i);
+    // Blocks of evict-first files leave the buffer at once
+    if (bf.files[frame->file_desc].hint == BF_HINT_EVICT_FIRST) {
+      ret = frame_evict(i);
+      if (ret == BF_OK)
+        free_push(i);
+    }
+  }
+
+  block->data = NULL;
+  block->dirty = 0;
+  block->frame = BF_NONE;
+  return ret;
+}
+
+BF_ErrorCode BF_ReadBlocks(const int file_desc, const int first_block, const int count,
+                           BF_Block **blocks) {
+  if (!bf_valid_file(file_desc))
+    return BF_INVALID_FILE_ERROR;
+  if (first_block < 0 || count < 0 || first_block + count > bf.files[file_desc].block_num)
+    return BF_INVALID_BLOCK_NUMBER_ERROR;
+  for (int i = 0; i < count; i++)
+    if (blocks[i]->frame == BF_NONE)
+      return BF_ERROR;
+
+  BF_File* file = &bf.files[file_desc];
+  if (file->mapped) {
+    for (int i = 0; i < count; i++)
+      memcpy(blocks[i]->data, file->map_base + (size_t)(first_block + i) * bf.block_size,
+             bf.block_size);
+    return BF_OK;
+  }
+
+  struct iovec iov[BF_IOV_MAX];
+  int i = 0;
+  while (i < count) {
+    // A block in memory may be newer than the one on the disk
+    int frame = hash_find(file_desc, first_block + i);
+    if (frame != BF_NONE) {
+      memcpy(blocks[i]->data, bf.frames[frame].data, bf.block_size);
+      i++;
+      continue;
+    }
+    // The blocks up to the next one in memory are read together
+    int n = 0;
+    while (i + n < count && n < BF_IOV_MAX && hash_find(file_desc, first_block + i + n) == BF_NONE) {
+      iov[n].iov_base = blocks[i + n]->data;
+      iov[n].iov_len = bf.block_size;
+      n++;
+    }
+    off_t offset = (off_t)(first_block + i) * bf.block_size;
+    ssize_t got = preadv(file->os_fd, iov, n, offset);
+    if (got < 0)
+      return BF_ERROR;
+    // Blocks after the end of the file were allocated but never written, and
+    // the rest of a short read is read block by block
+    for (int j = 0; j < n; j++) {
+      ssize_t start = (ssize_t)j * bf.block_size;
+      if (got >= start + bf.block_size)
+        continue;
+      ssize_t have = (got > start) ? got - start : 0;
+      ssize_t more = pread(file->os_fd, blocks[i + j]->data + have, bf.block_size - have,
+                           offset + start + have);
+      if (more < 0)
+        return BF_ERROR;
+      memset(blocks[i + j]->data + have + more, 0, bf.block_size - have - more);
+    }
+    i += n;
+  }
+  return BF_OK;
+}
+
+BF_ErrorCode BF_WriteBlock(BF_Block *block) {
+  // Only the pinned data and the descriptor of its file are used, so other BF
+  // calls may run at the same time
+  if (block->frame == BF_NONE)
+    return BF_ERROR;
+  if (block->frame == BF_MAPPED)
+    return BF_OK;
+  off_t offset = (off_t)block->block_num * bf.block_size;
+  if (pwrite(bf.files[block->file_desc].os_fd, block->data, bf.block_size, offset) != bf.block_size)
+    return BF_ERROR;
+  block->written = 1;
+  return BF_OK;
+}
+
+void BF_PrintError(BF_ErrorCode err) {
+  if (err >= BF_OK && err <= BF_ERROR)
+    fprintf(stderr, "BF Error: %s\n", bf_messages[err]);
+}
+
+BF_ErrorCode BF_Close() {
+  if (!bf.active)
+    return BF_ERROR;
+  BF_ErrorCode ret = BF_OK;
+  for (int i = 0; i < BF_MAX_OPEN_FILES; i++) {
+    if (bf.files[i].os_fd == BF_NONE)
+      continue;
+    if (bf.files[i].mapped && map_close(&bf.files[i]) != BF_OK)
+      ret = BF_ERROR;
+    // Write back every block of the file, even if it is still pinned
+    for (int j = 0; j < bf.buffer_size; j++)
+      if (bf.frames[j].file_desc == i && bf.frames[j].dirty && frame_write(j) != BF_OK)
+        ret = BF_ERROR;
+    close(bf.files[i].os_fd);
+    bf.files[i].os_fd = BF_NONE;
+  }
+  free(bf.frames);
+  free(bf.frame_data);
+  free(bf.hash);
+  bf.active = 0;
+  return ret;
+}
+
+int BF_GetBlockSize() {
+  return bf.active ? bf.block_size : BF_BLOCK_SIZE;
+}
+
+int BF_GetBufferSize() {
+  return bf.active ? bf.buffer_size : BF_BUFFER_SIZE;
+}
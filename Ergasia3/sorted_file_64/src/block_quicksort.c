@@ -1,42 +1,45 @@
 #include <stdio.h>
 
-#include "block_quicksort.h"
 #include "sort_file.h"
 #include "sr_utils.h"
+#include "block_quicksort.h"
 
 /*
  * Standard quicksort algorthm implemented for sorting records
  * of an input buffer block array
- * Buffer_data is the buffer array, low and high are the starting
- * and ending indexes respectively and fieldNo is the element we want
- * to sort the buffers by
+ * Addr addresses the records of the buffer array in constant time,
+ * low and high are the starting and ending indexes respectively and
+ * cmp is the comparator of the field we want to sort the buffers by
+ * (called with its context cmp_ctx)
  *
  * In this implementation the last element is always picked as pivot
  */
 
-void block_quicksort(char** buffer_data, int fieldNo, int low, int high) {
+void block_quicksort(const RecordAddr* addr, RecordCmp cmp, const void* cmp_ctx,
+                     int low, int high) {
     if (low < high) {
-        int pivot_location = block_partition(buffer_data, fieldNo, low, high);
+        int pivot_location = block_partition(addr, cmp, cmp_ctx, low, high);
         // Call recursively for before and after pivot location
-        block_quicksort(buffer_data, fieldNo, low, pivot_location - 1);
-        block_quicksort(buffer_data, fieldNo, pivot_location + 1, high);
+        block_quicksort(addr, cmp, cmp_ctx, low, pivot_location - 1);
+        block_quicksort(addr, cmp, cmp_ctx, pivot_location + 1, high);
     }
 }
 
-int block_partition(char** buffer_data, int fieldNo, int low, int high) {
-    Record* pivot = get_nth_record(buffer_data, high);
+int block_partition(const RecordAddr* addr, RecordCmp cmp, const void* cmp_ctx,
+                    int low, int high) {
+    Record* pivot = record_addr_get(addr, high);
     int leftwall = low - 1;
 
     for (int i = low; i <= high - 1; i++) {
-        Record* curr_rec = get_nth_record(buffer_data, i);
-        if (record_cmp(fieldNo, *curr_rec, *pivot) < 1) {
+        Record* curr_rec = record_addr_get(addr, i);
+        if (cmp(curr_rec, pivot, cmp_ctx) <= 0) {
             leftwall++;
-            Record* curr_leftwall_rec = get_nth_record(buffer_data, leftwall);
+            Record* curr_leftwall_rec = record_addr_get(addr, leftwall);
             record_swap(curr_rec, curr_leftwall_rec);
         }
     }
     leftwall++;
-    Record* leftwall_rec = get_nth_record(buffer_data, leftwall);
+    Record* leftwall_rec = record_addr_get(addr, leftwall);
     record_swap(pivot,leftwall_rec);
 
     return leftwall;
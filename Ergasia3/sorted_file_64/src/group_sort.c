@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "block_quicksort.h"
+#include "key_sort.h"
+#include "radix_sort.h"
+#include "multikey_quicksort.h"
+#include "reduce.h"
+#include "group_sort.h"
+
+// Prepares a sorter for groups of up to max_blocks blocks, sorted with cmp and
+// its context cmp_ctx (the KeySpec of a sort by keys, which the key/pointer sort also uses)
+// If reduce is not NULL every group is also reduced after it is sorted
+// Returns 0 on success, -1 if memory could not be allocated
+int group_sorter_init(GroupSorter* sorter, SR_GroupSort group_sort, int fieldNo,
+                      RecordCmp cmp, const void* cmp_ctx, const Reducer* reduce,
+                      int max_blocks) {
+  // Pick the sort of the groups once, radix sort only works on the id
+  // and multikey quicksort only on the string fields, a sort by keys
+  // sorts the array of composite key prefixes
+  if (fieldNo == SORT_FIELD_KEYS && group_sort != SR_SORT_IN_PLACE)
+    group_sort = SR_SORT_KEY_POINTER;
+  if (group_sort == SR_SORT_AUTO)
+    group_sort = (fieldNo == 0) ? SR_SORT_RADIX : SR_SORT_MULTIKEY;
+  if (group_sort == SR_SORT_RADIX && fieldNo != 0)
+    group_sort = SR_SORT_KEY_POINTER;
+  if (group_sort == SR_SORT_MULTIKEY && fieldNo == 0)
+    group_sort = SR_SORT_RADIX;
+
+  sorter->group_sort = group_sort;
+  sorter->fieldNo = fieldNo;
+  sorter->cmp = cmp;
+  sorter->cmp_ctx = cmp_ctx;
+  sorter->reduce = reduce;
+  sorter->keys = NULL;
+  sorter->tmp_keys = NULL;
+  sorter->scratch = NULL;
+
+  // Key arrays and scratch records of the key/pointer sorts (one group at a time)
+  if (group_sort != SR_SORT_IN_PLACE) {
+    int max_records = max_blocks * sr_records_per_block();
+    sorter->keys = malloc(max_records * sizeof(SortKey));
+    sorter->tmp_keys = malloc(max_records * sizeof(SortKey));
+    sorter->scratch = malloc(max_records * sizeof(Record));
+    if (sorter->keys == NULL || sorter->tmp_keys == NULL || sorter->scratch == NULL) {
+      group_sorter_destroy(sorter);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void group_sorter_destroy(GroupSorter* sorter) {
+  free(sorter->keys);
+  free(sorter->tmp_keys);
+  free(sorter->scratch);
+  sorter->keys = NULL;
+  sorter->tmp_keys = NULL;
+  sorter->scratch = NULL;
+}
+
+// Sorts the records of group_blocks loaded blocks (buff_data) in place
+// Returns the number of records (after the reduction), or -1 if memory could not be allocated
+int group_sorter_sort(GroupSorter* sorter, char** buff_data, int group_blocks) {
+  int tot_records = 0;
+  if (sorter->group_sort != SR_SORT_IN_PLACE) {
+    // Sort the key array and move every record once
+    tot_records = key_sort_extract(buff_data, group_blocks, sorter->fieldNo, sorter->cmp_ctx,
+                                   sorter->keys);
+    if (sorter->group_sort == SR_SORT_RADIX)
+      radix_sort_keys(sorter->keys, sorter->tmp_keys, tot_records);
+    else if (sorter->group_sort == SR_SORT_MULTIKEY)
+      multikey_quicksort(sorter->keys, tot_records, sorter->fieldNo);
+    else
+      key_sort(sorter->keys, tot_records, sorter->fieldNo, sorter->cmp_ctx);
+    key_sort_permute(buff_data, group_blocks, sorter->keys, tot_records, sorter->scratch);
+  }
+  else {
+    // Records are addressed in constant time by the quicksort
+    RecordAddr addr;
+    tot_records = record_addr_init(&addr, buff_data, group_blocks);
+    if (tot_records < 0)
+      return -1;
+    // Call quicksort
+    int low = 0;
+    int high = tot_records - 1;
+    block_quicksort(&addr, sorter->cmp, sorter->cmp_ctx, low, high);
+    record_addr_destroy(&addr);
+  }
+  if (sorter->reduce != NULL)
+    tot_records = reduce_group(sorter->reduce, buff_data, group_blocks);
+  return tot_records;
+}
+
+// Only the source BF layer reads many blocks at once
+#pragma weak BF_ReadBlocks
+
+// Unpins the blocks of a group that could not be loaded, so its file can be closed
+static int group_abort(BF_Block** blocks, int group_blocks) {
+  for (int i = 0; i < group_blocks; i++)
+    BF_UnpinBlock(blocks[i]);
+  return -1;
+}
+
+// Allocates up to max_blocks blocks at the end of fileDesc and copies into them
+// the next whole blocks of a reader that is at the start of a block: the pinned
+// block of the reader and, with one BF_ReadBlocks, the blocks after it
+// Returns the number of blocks, -1 on error
+static int group_read_blocks(RunReader* reader, int fileDesc, BF_Block** blocks,
+                             char** buff_data, int max_blocks) {
+  int group_blocks = reader->end_block - reader->block_num;
+  if (group_blocks > max_blocks)
+    group_blocks = max_blocks;
+  for (int i = 0; i < group_blocks; i++) {
+    BF_ErrorCode code = BF_AllocateBlock(fileDesc, blocks[i]);
+    if (code != BF_OK) {
+      BF_PrintError(code);
+      return group_abort(blocks, i);
+    }
+    buff_data[i] = BF_Block_GetData(blocks[i]);
+  }
+  memcpy(buff_data[0], BF_Block_GetData(reader->block), sr_block_size());
+  if (group_blocks > 1) {
+    BF_ErrorCode code = BF_ReadBlocks(reader->fileDesc, reader->block_num + 1, group_blocks - 1,
+                                      blocks + 1);
+    if (code != BF_OK) {
+      BF_PrintError(code);
+      return group_abort(blocks, group_blocks);
+    }
+  }
+  if (run_reader_skip_blocks(reader, group_blocks) != SR_OK)
+    return group_abort(blocks, group_blocks);
+  return group_blocks;
+}
+
+// Fills up to max_blocks newly allocated blocks at the end of fileDesc with the
+// next records of the reader, sr_records_per_block() per block (zero padded if
+// normalize is set). The blocks stay pinned, their data is put in buff_data
+// Returns the number of blocks filled (0 if the reader is exhausted), -1 on error
+// (with none of the blocks left pinned)
+int group_load(RunReader* reader, int fileDesc, BF_Block** blocks, char** buff_data,
+               int max_blocks, int normalize) {
+  const int recs_per_block = sr_records_per_block();
+  int group_blocks = 0;
+  int block_i = 0;    // position of the next record in the group
+  int slot_i = 0;
+
+  // Whole input blocks are read in one go. Sort files are packed, so the
+  // records usually stay where they are, otherwise they are packed here
+  if (BF_ReadBlocks != NULL && run_reader_current(reader) != NULL && reader->rec_i == 0 &&
+      reader->remaining < 0 && reader->copy == NULL && reader->ahead == NULL) {
+    group_blocks = group_read_blocks(reader, fileDesc, blocks, buff_data, max_blocks);
+    if (group_blocks < 0)
+      return -1;
+    for (int i = 0; i < group_blocks; i++) {
+      int rec_num;
+      memcpy(&rec_num, buff_data[i], sizeof(int));
+      for (int j = 0; j < rec_num; j++) {
+        if (slot_i == recs_per_block) {
+          block_i++;
+          slot_i = 0;
+        }
+        Record* src = (Record*)(buff_data[i] + sizeof(int)) + j;
+        Record* slot = (Record*)(buff_data[block_i] + sizeof(int)) + slot_i;
+        if (slot != src)
+          *slot = *src;
+        if (normalize)
+          record_normalize(slot);
+        slot_i++;
+      }
+    }
+  }
+
+  // The rest of the group (all of it without BF_ReadBlocks) is filled record by record
+  Record* record;
+  while ((record = run_reader_current(reader)) != NULL) {
+    if (slot_i == recs_per_block) {
+      block_i++;
+      slot_i = 0;
+    }
+    if (block_i == group_blocks) {
+      if (group_blocks == max_blocks)
+        break;
+      BF_ErrorCode code = BF_AllocateBlock(fileDesc, blocks[group_blocks]);
+      if (code != BF_OK) {
+        BF_PrintError(code);
+        return group_abort(blocks, group_blocks);
+      }
+      buff_data[group_blocks] = BF_Block_GetData(blocks[group_blocks]);
+      group_blocks++;
+    }
+    Record* slot = (Record*)(buff_data[block_i] + sizeof(int)) + slot_i;
+    *slot = *record;
+    // Zero pad the string fields on the way, if the comparator expects it
+    if (normalize)
+      record_normalize(slot);
+    slot_i++;
+    if (run_reader_next(reader) != SR_OK)
+      return group_abort(blocks, group_blocks);
+  }
+
+  // Record counters (blocks after the last record stay empty)
+  for (int i = 0; i < group_blocks; i++) {
+    int rec_num = (i < block_i) ? recs_per_block : (i == block_i) ? slot_i : 0;
+    memcpy(buff_data[i], &rec_num, sizeof(int));
+  }
+  return group_blocks;
+}
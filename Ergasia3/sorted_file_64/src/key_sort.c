@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "key_sort.h"
+
+/*
+ * Key/pointer sort of a group of blocks (phase 1 of SR_SortedFile)
+ * Instead of swapping whole records across the block buffers, a compact
+ * array of (normalized key prefix, record pointer) entries is built once,
+ * sorted, and then the records are written back in order with a single
+ * permutation pass. Most comparisons are decided by the prefixes alone.
+ */
+
+// Below this size partitions are finished with insertion sort
+#define INSERTION_SORT_THRESHOLD 16
+
+// Normalized prefix of a record's field (spec holds the keys of a sort by keys)
+static unsigned long long key_prefix(const Record* record, int fieldNo, const KeySpec* spec) {
+  if (fieldNo == SORT_FIELD_KEYS)
+    return record_keys_prefix(record, spec);
+
+  // Flipping the sign bit makes negative ids order before positive ones as unsigned
+  if (fieldNo == 0)
+    return (unsigned long long)((unsigned int)record->id ^ 0x80000000u) << 32;
+
+  // First 8 characters in big endian order, every byte after the '\0' is 0
+  const char* field = (const char*)record + string_field_offset(fieldNo);
+  unsigned long long prefix = 0;
+  int i = 0;
+  for (; i < 8 && field[i] != '\0'; i++)
+    prefix = (prefix << 8) | (unsigned char)field[i];
+  // An empty field would take a shift by 64, which is undefined
+  if (i == 0)
+    return 0;
+  return prefix << (8 * (8 - i));
+}
+
+// Compares two entries, the fields are only read if the prefixes are not enough
+static inline int key_cmp(const SortKey* a, const SortKey* b, int fieldNo,
+                          const KeySpec* spec) {
+  if (a->prefix != b->prefix)
+    return (a->prefix < b->prefix) ? -1 : 1;
+  if (fieldNo == SORT_FIELD_KEYS)
+    return record_cmp_keys(a->record, b->record, spec);
+  // Ids are compared whole, and a string that ends inside the prefix
+  // (its last prefix byte is 0) is equal to the other one
+  if (fieldNo == 0 || (a->prefix & 0xFF) == 0)
+    return 0;
+  size_t offset = string_field_offset(fieldNo) + 8;
+  return strcmp((const char*)a->record + offset, (const char*)b->record + offset);
+}
+
+static inline void key_swap(SortKey* a, SortKey* b) {
+  SortKey t = *a;
+  *a = *b;
+  *b = t;
+}
+
+// Fills keys with one entry per record of the group of blocks
+// Returns the number of records
+int key_sort_extract(char** buffer_data, int block_num, int fieldNo, const KeySpec* spec,
+                     SortKey* keys) {
+  int n = 0;
+  for (int i = 0; i < block_num; i++) {
+    int rec_num = 0;
+    memcpy(&rec_num, buffer_data[i], sizeof(int));
+    Record* records = (Record*)(buffer_data[i] + sizeof(int));
+    for (int j = 0; j < rec_num; j++) {
+      keys[n].prefix = key_prefix(&records[j], fieldNo, spec);
+      keys[n].record = &records[j];
+      n++;
+    }
+  }
+  return n;
+}
+
+static void insertion_sort(SortKey* keys, int n, int fieldNo, const KeySpec* spec) {
+  for (int i = 1; i < n; i++) {
+    SortKey key = keys[i];
+    int j = i - 1;
+    while (j >= 0 && key_cmp(&key, &keys[j], fieldNo, spec) < 0) {
+      keys[j + 1] = keys[j];
+      j--;
+    }
+    keys[j + 1] = key;
+  }
+}
+
+// Quicksort with a median of three pivot and Hoare partitioning, which
+// splits runs of equal keys evenly instead of putting them on one side
+// spec is the KeySpec of a sort by keys (SORT_FIELD_KEYS), NULL otherwise
+void key_sort(SortKey* keys, int n, int fieldNo, const KeySpec* spec) {
+  while (n > INSERTION_SORT_THRESHOLD) {
+    int mid = n / 2;
+    if (key_cmp(&keys[mid], &keys[0], fieldNo, spec) < 0)
+      key_swap(&keys[mid], &keys[0]);
+    if (key_cmp(&keys[n - 1], &keys[0], fieldNo, spec) < 0)
+      key_swap(&keys[n - 1], &keys[0]);
+    if (key_cmp(&keys[n - 1], &keys[mid], fieldNo, spec) < 0)
+      key_swap(&keys[n - 1], &keys[mid]);
+    SortKey pivot = keys[mid];
+
+    int i = -1;
+    int j = n;
+    while (1) {
+      do i++; while (key_cmp(&keys[i], &pivot, fieldNo, spec) < 0);
+      do j--; while (key_cmp(&pivot, &keys[j], fieldNo, spec) < 0);
+      if (i >= j)
+        break;
+      key_swap(&keys[i], &keys[j]);
+    }
+
+    // Recurse into the smaller part and loop on the larger one
+    int left_n = j + 1;
+    if (left_n < n - left_n) {
+      key_sort(keys, left_n, fieldNo, spec);
+      keys += left_n;
+      n -= left_n;
+    }
+    else {
+      key_sort(keys + left_n, n - left_n, fieldNo, spec);
+      n = left_n;
+    }
+  }
+  insertion_sort(keys, n, fieldNo, spec);
+}
+
+// Writes the records back into the blocks in the order of the sorted keys
+// The records are gathered into scratch (room for n records) first, because
+// the keys point into the blocks that are being overwritten
+void key_sort_permute(char** buffer_data, int block_num, const SortKey* keys, int n, Record* scratch) {
+  for (int i = 0; i < n; i++)
+    scratch[i] = *keys[i].record;
+
+  int copied = 0;
+  for (int i = 0; i < block_num; i++) {
+    int rec_num = 0;
+    memcpy(&rec_num, buffer_data[i], sizeof(int));
+    memcpy(buffer_data[i] + sizeof(int), &scratch[copied], rec_num*sizeof(Record));
+    copied += rec_num;
+  }
+}
@@ -0,0 +1,111 @@
+#include <stdlib.h>
+
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "loser_tree.h"
+
+// Returns 1 if input a wins the match against input b
+// Exhausted inputs always lose and ties are won by the smaller input index,
+// so records with equal keys leave the merge in the order of their inputs
+static int beats(const LoserTree* tree, int a, int b) {
+  Record* rec_a = tree->current[a];
+  Record* rec_b = tree->current[b];
+  if (rec_a == NULL)
+    return 0;
+  if (rec_b == NULL)
+    return 1;
+  int cmp = tree->cmp(rec_a, rec_b, tree->cmp_ctx);
+  return cmp < 0 || (cmp == 0 && a < b);
+}
+
+// Allocates a tree for up to capacity inputs, compared by cmp with its context cmp_ctx
+// Returns 0 on success, -1 if memory could not be allocated
+int loser_tree_init(LoserTree* tree, int capacity, RecordCmp cmp, const void* cmp_ctx) {
+  tree->capacity = capacity;
+  tree->k = 0;
+  tree->active = 0;
+  tree->cmp = cmp;
+  tree->cmp_ctx = cmp_ctx;
+  tree->losers = malloc(capacity * sizeof(int));
+  tree->current = malloc(capacity * sizeof(Record*));
+  if (tree->losers == NULL || tree->current == NULL) {
+    loser_tree_destroy(tree);
+    return -1;
+  }
+  for (int i = 0; i < capacity; i++)
+    tree->current[i] = NULL;
+  return 0;
+}
+
+void loser_tree_destroy(LoserTree* tree) {
+  free(tree->losers);
+  free(tree->current);
+  tree->losers = NULL;
+  tree->current = NULL;
+}
+
+// Sets the first record of an input (NULL for an empty input)
+// Must be called for inputs 0..k-1 before loser_tree_build
+void loser_tree_set_input(LoserTree* tree, int input, Record* record) {
+  tree->current[input] = record;
+}
+
+// Plays the whole tournament for inputs 0..k-1 (k - 1 comparisons)
+// Leaves are the implicit nodes k..2k-1, so node j has children 2j and 2j+1
+void loser_tree_build(LoserTree* tree, int k) {
+  tree->k = k;
+  tree->active = 0;
+  for (int i = 0; i < k; i++)
+    if (tree->current[i] != NULL)
+      tree->active++;
+
+  if (k <= 1) {
+    tree->losers[0] = 0;
+    return;
+  }
+
+  // Winner of every internal node, only needed while building
+  int winners[k];
+  for (int node = k - 1; node >= 1; node--) {
+    int left = 2*node;
+    int right = 2*node + 1;
+    int left_winner = (left >= k) ? left - k : winners[left];
+    int right_winner = (right >= k) ? right - k : winners[right];
+
+    if (beats(tree, right_winner, left_winner)) {
+      winners[node] = right_winner;
+      tree->losers[node] = left_winner;
+    }
+    else {
+      winners[node] = left_winner;
+      tree->losers[node] = right_winner;
+    }
+  }
+  tree->losers[0] = winners[1];
+}
+
+// Returns the input that holds the smallest record, or -1 if all inputs are exhausted
+int loser_tree_winner(const LoserTree* tree) {
+  if (tree->active == 0)
+    return -1;
+  return tree->losers[0];
+}
+
+// Replaces the record of the current winner with the next record of its input
+// (NULL if that input has no more records) and replays its path to the root
+void loser_tree_replace_winner(LoserTree* tree, Record* next) {
+  int winner = tree->losers[0];
+  if (next == NULL && tree->current[winner] != NULL)
+    tree->active--;
+  tree->current[winner] = next;
+
+  for (int node = (winner + tree->k) / 2; node > 0; node /= 2) {
+    // The stored loser plays against the winner coming up from below
+    if (beats(tree, tree->losers[node], winner)) {
+      int tmp = tree->losers[node];
+      tree->losers[node] = winner;
+      winner = tmp;
+    }
+  }
+  tree->losers[0] = winner;
+}
@@ -0,0 +1,310 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "loser_tree.h"
+#include "run_io.h"
+#include "sparse_index.h"
+#include "merge.h"
+
+#define CHK_BF_ERR(call)      \
+  {                           \
+    BF_ErrorCode code = call; \
+    if (code != BF_OK) {      \
+      BF_PrintError(code);    \
+      return SR_ERROR;        \
+    }                         \
+  }
+
+// Merges k runs of the temp file half that starts at block base into the writer
+// Run i is read through buff_blocks[i], and through copies[i*sr_block_size()] if
+// copies is not NULL. If ahead is not NULL its next block is read ahead into
+// ahead_blocks[i] instead. At most limit records are written (-1 for all)
+SR_ErrorCode merge_runs(int temp_fileDesc, int base, int half_block_num, const Run* runs,
+                        int k, BF_Block** buff_blocks, char* copies, ReadAhead* ahead,
+                        BF_Block** ahead_blocks, LoserTree* tree, int limit,
+                        BlockWriter* writer) {
+  // No runs, nothing to merge (and no zero-length arrays below)
+  if (k == 0)
+    return block_writer_end_run(writer);
+
+  const int recs_per_block = sr_records_per_block();
+  SR_ErrorCode ret = SR_OK;
+  RunReader readers[k];
+  // Take the first block of every run and play the first tournament
+  int opened = 0;
+  for (; opened < k; opened++) {
+    int i = opened;
+    int first_block = base + runs[i].first_rec / recs_per_block;
+    int first_slot = runs[i].first_rec % recs_per_block;
+    if (ahead != NULL)
+      ret = run_reader_open_ahead(&readers[i], temp_fileDesc, buff_blocks[i], ahead_blocks[i],
+                                  ahead, first_block, base + half_block_num, first_slot,
+                                  runs[i].rec_num);
+    else
+      ret = run_reader_open_copy(&readers[i], temp_fileDesc, buff_blocks[i],
+                                 (copies == NULL) ? NULL : copies + (size_t)i*sr_block_size(),
+                                 first_block, base + half_block_num, first_slot,
+                                 runs[i].rec_num);
+    if (ret != SR_OK)
+      break;
+    loser_tree_set_input(tree, i, run_reader_current(&readers[i]));
+  }
+  if (ret == SR_OK)
+    loser_tree_build(tree, k);
+
+  int min_record_i;
+  for (int merged = 0; ret == SR_OK && merged != limit &&
+                       (min_record_i = loser_tree_winner(tree)) != -1; merged++) {
+    // Copy the whole record to the output block
+    ret = block_writer_put(writer, run_reader_current(&readers[min_record_i]));
+    // Move on in the run of the min record (the reader gets its next block when needed)
+    // and replay the winner's path with its next record (NULL if the run is exhausted)
+    if (ret == SR_OK)
+      ret = run_reader_next(&readers[min_record_i]);
+    if (ret == SR_OK)
+      loser_tree_replace_winner(tree, run_reader_current(&readers[min_record_i]));
+  }
+
+  // The merged run ends here, also for a writer that reduces its records
+  if (ret == SR_OK)
+    ret = block_writer_end_run(writer);
+  // Runs that were not read to the end (the limit was reached or an error
+  // occurred) still have a block pinned
+  for (int i = 0; i < opened; i++)
+    if (run_reader_close(&readers[i]) != SR_OK)
+      ret = SR_ERROR;
+  return ret;
+}
+
+/*
+ * Parallel final merge
+ * The output is cut into one range of whole blocks per thread. For every
+ * cut, the position of each run where the records of the next range start
+ * is found with binary searches (ties go to the lower run, like in the
+ * loser tree), so each thread merges its own slices of the k runs into its
+ * own blocks of the output file, independently of the others. Each thread
+ * needs k+1 buffer blocks. The readers and writers share the BF layer
+ * through the lock of run_io.c, and since two threads may start and end a
+ * slice in the same block, the readers work on private copies of the
+ * blocks instead of keeping them pinned.
+ */
+
+typedef struct MergeTask {
+  pthread_t thread;
+  int temp_fileDesc;
+  int base;
+  int half_block_num;
+  Run* slices;         // the part of every run this thread merges
+  int k;
+  RecordCmp cmp;
+  const void* cmp_ctx;
+  BF_Block** buff_blocks;  // k readers and the writer
+  int output_fileDesc;
+  int first_block;     // first output block of the thread
+  SparseIndex* index;  // shared by the threads, each sets the keys of its own blocks
+  SR_ErrorCode result;
+} MergeTask;
+
+static void* merge_task_main(void* arg) {
+  MergeTask* task = arg;
+  task->result = SR_ERROR;
+
+  LoserTree tree;
+  if (loser_tree_init(&tree, task->k, task->cmp, task->cmp_ctx) != 0)
+    return NULL;
+  char* copies = malloc((size_t)task->k * sr_block_size());
+  if (copies == NULL) {
+    loser_tree_destroy(&tree);
+    return NULL;
+  }
+  BlockWriter writer;
+  block_writer_open(&writer, task->output_fileDesc, task->buff_blocks[task->k],
+                    task->first_block, 0);
+  writer.index = task->index;
+  if (merge_runs(task->temp_fileDesc, task->base, task->half_block_num, task->slices,
+                 task->k, task->buff_blocks, copies, NULL, NULL, &tree, -1, &writer) == SR_OK &&
+      block_writer_close(&writer) == SR_OK)
+    task->result = SR_OK;
+  else
+    block_writer_abort(&writer);
+  loser_tree_destroy(&tree);
+  free(copies);
+  return NULL;
+}
+
+// Reads record rec of the temp file half that starts at block base
+static SR_ErrorCode read_record(int temp_fileDesc, BF_Block* block, int base, int rec,
+                                Record* record) {
+  const int recs_per_block = sr_records_per_block();
+  CHK_BF_ERR(BF_GetBlock(temp_fileDesc, base + rec / recs_per_block, block));
+  char* data = BF_Block_GetData(block);
+  memcpy(record, data + sizeof(int) + (rec % recs_per_block)*sizeof(Record), sizeof(Record));
+  CHK_BF_ERR(BF_UnpinBlock(block));
+  return SR_OK;
+}
+
+// Counts the records of the run that are smaller than key
+// (or not greater than key if inclusive is set)
+static SR_ErrorCode count_before(int temp_fileDesc, BF_Block* block, int base, const Run* run,
+                                 const Record* key, int inclusive, RecordCmp cmp,
+                                 const void* cmp_ctx, int* count) {
+  int low = 0;
+  int high = run->rec_num;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    Record record;
+    if (read_record(temp_fileDesc, block, base, run->first_rec + mid, &record) != SR_OK)
+      return SR_ERROR;
+    int c = cmp(&record, key, cmp_ctx);
+    if (c < 0 || (inclusive && c == 0))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  *count = low;
+  return SR_OK;
+}
+
+// Number of records of all the runs that come before record pos of run i in
+// the merged order. The positions in every run are stored in split
+static SR_ErrorCode merged_rank(int temp_fileDesc, BF_Block* block, int base, const Run* runs,
+                                int k, int i, int pos, RecordCmp cmp, const void* cmp_ctx,
+                                int* split, int* rank) {
+  Record key;
+  if (read_record(temp_fileDesc, block, base, runs[i].first_rec + pos, &key) != SR_OK)
+    return SR_ERROR;
+  *rank = 0;
+  for (int j = 0; j < k; j++) {
+    if (j == i)
+      split[j] = pos;
+    else if (count_before(temp_fileDesc, block, base, &runs[j], &key, j < i, cmp, cmp_ctx,
+                          &split[j]) != SR_OK)
+      return SR_ERROR;
+    *rank += split[j];
+  }
+  return SR_OK;
+}
+
+// Finds where the first rank records of the merged order end in every run
+static SR_ErrorCode find_split(int temp_fileDesc, BF_Block* block, int base, const Run* runs,
+                               int k, int rank, RecordCmp cmp, const void* cmp_ctx,
+                               int* split) {
+  // The record with this rank is in exactly one of the runs
+  for (int i = 0; i < k; i++) {
+    int low = 0;
+    int high = runs[i].rec_num - 1;
+    // Find the last record of run i whose rank is not above the wanted one
+    while (low <= high) {
+      int mid = low + (high - low) / 2;
+      int mid_rank;
+      if (merged_rank(temp_fileDesc, block, base, runs, k, i, mid, cmp, cmp_ctx, split,
+                      &mid_rank) != SR_OK)
+        return SR_ERROR;
+      if (mid_rank == rank)
+        return SR_OK;
+      if (mid_rank < rank)
+        low = mid + 1;
+      else
+        high = mid - 1;
+    }
+  }
+  return SR_ERROR;
+}
+
+// Merges the k runs of the temp file half that starts at block base into the
+// output file from block first_block on, with up to threads threads, in the
+// order of cmp (with its context cmp_ctx). The
+// caller must leave threads*(k+1) buffer blocks for the merge
+// If index is not NULL it gets the first record of every output block
+SR_ErrorCode parallel_merge_runs(int temp_fileDesc, int base, int half_block_num,
+                                 const Run* runs, int k, int threads, RecordCmp cmp,
+                                 const void* cmp_ctx, BF_Block** buff_blocks,
+                                 int output_fileDesc, int first_block, SparseIndex* index) {
+  const int recs_per_block = sr_records_per_block();
+  int tot_records = 0;
+  for (int j = 0; j < k; j++)
+    tot_records += runs[j].rec_num;
+  // Every thread gets at least one whole block
+  int tot_blocks = (tot_records + recs_per_block - 1) / recs_per_block;
+  if (threads > tot_blocks)
+    threads = tot_blocks;
+  if (index != NULL && sparse_index_reserve(index, first_block + tot_blocks - 1) != 0)
+    return SR_ERROR;
+
+  MergeTask* tasks = calloc(threads, sizeof(MergeTask));
+  int* splits = malloc((threads + 1) * k * sizeof(int));
+  Run* slices = malloc(threads * k * sizeof(Run));
+  if (tasks == NULL || splits == NULL || slices == NULL) {
+    free(tasks);
+    free(splits);
+    free(slices);
+    return SR_ERROR;
+  }
+
+  // The output is cut on block boundaries, splits[t*k + j] is where the
+  // slice of thread t starts in run j
+  int* split = splits;
+  for (int t = 0; t <= threads; t++, split += k) {
+    int block_cut = (int)((long long)tot_blocks * t / threads);
+    int rank = block_cut * recs_per_block;
+    if (rank >= tot_records) {
+      for (int j = 0; j < k; j++)
+        split[j] = runs[j].rec_num;
+    }
+    else if (rank == 0) {
+      for (int j = 0; j < k; j++)
+        split[j] = 0;
+    }
+    else if (find_split(temp_fileDesc, buff_blocks[0], base, runs, k, rank, cmp, cmp_ctx,
+                          split) != SR_OK) {
+      free(tasks);
+      free(splits);
+      free(slices);
+      return SR_ERROR;
+    }
+    if (t < threads)
+      tasks[t].first_block = first_block + block_cut;
+  }
+
+  // Start the threads, each on its own slices and buffer blocks
+  SR_ErrorCode ret = SR_OK;
+  int started = 0;
+  for (; started < threads; started++) {
+    MergeTask* task = &tasks[started];
+    task->temp_fileDesc = temp_fileDesc;
+    task->base = base;
+    task->half_block_num = half_block_num;
+    task->slices = &slices[started * k];
+    task->k = k;
+    task->cmp = cmp;
+    task->cmp_ctx = cmp_ctx;
+    task->buff_blocks = buff_blocks + started*(k + 1);
+    task->output_fileDesc = output_fileDesc;
+    task->index = index;
+    for (int j = 0; j < k; j++) {
+      int from = splits[started*k + j];
+      int to = splits[(started + 1)*k + j];
+      task->slices[j].first_rec = runs[j].first_rec + from;
+      task->slices[j].rec_num = to - from;
+    }
+    if (pthread_create(&task->thread, NULL, merge_task_main, task) != 0) {
+      ret = SR_ERROR;
+      break;
+    }
+  }
+
+  for (int t = 0; t < started; t++) {
+    pthread_join(tasks[t].thread, NULL);
+    if (tasks[t].result != SR_OK)
+      ret = SR_ERROR;
+  }
+
+  free(tasks);
+  free(splits);
+  free(slices);
+  return ret;
+}
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "merge_join.h"
+
+/*
+ * Sort-merge join of two files sorted by the same field (SR_MergeJoin)
+ * Both files are read once, side by side, and the reader with the smaller
+ * key moves on. When the keys meet, the first left record of the key group
+ * is joined with the right records while the right reader passes them, and
+ * every other left record of the group reads the right group again from its
+ * first record, so a group of any size needs no memory. The readers work on
+ * private copies of the blocks, since the rereads may meet the right reader
+ * in the same block (or the two files may be the same file), and the BF
+ * layer does not count the pins of a block.
+ */
+
+// Gives a joined pair to the writer (left, then right) and to the callback
+static SR_ErrorCode join_pair(const Record* left, const Record* right, BlockWriter* writer,
+                              SR_JoinCallback callback, void* arg) {
+  if (writer != NULL &&
+      (block_writer_put(writer, left) != SR_OK || block_writer_put(writer, right) != SR_OK))
+    return SR_ERROR;
+  if (callback != NULL)
+    callback(left, right, arg);
+  return SR_OK;
+}
+
+// Joins the data blocks (1 to end_block-1) of the two files through blocks[0..2]
+// Every pair goes to the writer and the callback, whichever is not NULL
+// cmp compares the join field, so it is called without a context
+SR_ErrorCode merge_join(int left_fileDesc, int left_end_block, int right_fileDesc,
+                        int right_end_block, RecordCmp cmp, BF_Block** blocks,
+                        BlockWriter* writer, SR_JoinCallback callback, void* arg) {
+  char* copies = malloc(3 * (size_t)sr_block_size());
+  if (copies == NULL)
+    return SR_ERROR;
+  char* group_copy = copies + 2 * (size_t)sr_block_size();
+
+  RunReader left;
+  RunReader right;
+  if (run_reader_open_copy(&left, left_fileDesc, blocks[0], copies, 1, left_end_block,
+                           0, -1) != SR_OK ||
+      run_reader_open_copy(&right, right_fileDesc, blocks[1], copies + sr_block_size(), 1,
+                           right_end_block, 0, -1) != SR_OK) {
+    free(copies);
+    return SR_ERROR;
+  }
+
+  SR_ErrorCode ret = SR_OK;
+  Record* l;
+  Record* r;
+  while (ret == SR_OK && (l = run_reader_current(&left)) != NULL &&
+         (r = run_reader_current(&right)) != NULL) {
+    int c = cmp(l, r, NULL);
+    if (c < 0) {
+      ret = run_reader_next(&left);
+      continue;
+    }
+    if (c > 0) {
+      ret = run_reader_next(&right);
+      continue;
+    }
+
+    // Start of a key group, remember where it starts in the right file
+    Record key = *l;
+    int group_block = right.block_num;
+    int group_slot = right.rec_i;
+    while (ret == SR_OK && (r = run_reader_current(&right)) != NULL && cmp(r, &key, NULL) == 0) {
+      ret = join_pair(l, r, writer, callback, arg);
+      if (ret == SR_OK)
+        ret = run_reader_next(&right);
+    }
+    if (ret == SR_OK)
+      ret = run_reader_next(&left);
+
+    // Every other left record of the group rereads the right group
+    while (ret == SR_OK && (l = run_reader_current(&left)) != NULL && cmp(l, &key, NULL) == 0) {
+      RunReader group;
+      ret = run_reader_open_copy(&group, right_fileDesc, blocks[2], group_copy, group_block,
+                                 right_end_block, group_slot, -1);
+      Record* g;
+      while (ret == SR_OK && (g = run_reader_current(&group)) != NULL && cmp(g, &key, NULL) == 0) {
+        ret = join_pair(l, g, writer, callback, arg);
+        if (ret == SR_OK)
+          ret = run_reader_next(&group);
+      }
+      if (run_reader_close(&group) != SR_OK)
+        ret = SR_ERROR;
+      if (ret == SR_OK)
+        ret = run_reader_next(&left);
+    }
+  }
+
+  if (run_reader_close(&left) != SR_OK)
+    ret = SR_ERROR;
+  if (run_reader_close(&right) != SR_OK)
+    ret = SR_ERROR;
+  free(copies);
+  return ret;
+}
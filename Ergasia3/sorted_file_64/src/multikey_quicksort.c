@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "key_sort.h"
+#include "multikey_quicksort.h"
+
+/*
+ * Multikey (three-way radix) quicksort of the key/pointer array of a group
+ * when sorting by a string field (Bentley & Sedgewick)
+ * Every partition looks at a single character (depth d) of the keys and
+ * splits them into smaller, equal and greater parts. Only the equal part
+ * moves on to the next character, so many records with the same string are
+ * settled in a few linear passes instead of falling on one side of a pivot.
+ * The first 8 characters are read from the prefix of the entries and only
+ * the rest from the records. If a part is split badly too many times the
+ * comparison sort of key_sort.c finishes it.
+ */
+
+// Below this size partitions are finished by the comparison sort
+#define MULTIKEY_THRESHOLD 12
+
+typedef struct FieldInfo {
+  size_t offset;
+  int size;
+} FieldInfo;
+
+// Returns character d of the field of an entry (0 after the end of the string)
+static inline int char_at(const SortKey* key, int d, const FieldInfo* field) {
+  if (d < 8)
+    return (int)((key->prefix >> (56 - 8*d)) & 0xFF);
+  if (d >= field->size)
+    return 0;
+  return (unsigned char)((const char*)key->record + field->offset)[d];
+}
+
+static inline void swap_keys(SortKey* keys, int a, int b) {
+  SortKey t = keys[a];
+  keys[a] = keys[b];
+  keys[b] = t;
+}
+
+static inline int median_of_three(int a, int b, int c) {
+  if (a < b) {
+    if (b < c) return b;
+    return (a < c) ? c : a;
+  }
+  if (a < c) return a;
+  return (b < c) ? c : b;
+}
+
+static void mkqs(SortKey* keys, int n, int d, int depth, int fieldNo, const FieldInfo* field) {
+  while (n > MULTIKEY_THRESHOLD) {
+    // Too many bad splits, fall back to the comparison sort
+    if (depth == 0) {
+      key_sort(keys, n, fieldNo, NULL);
+      return;
+    }
+
+    int pivot = median_of_three(char_at(&keys[0], d, field),
+                                char_at(&keys[n/2], d, field),
+                                char_at(&keys[n-1], d, field));
+
+    // Three-way partition: [0, lt) < pivot, [lt, gt) == pivot, [gt, n) > pivot
+    int lt = 0;
+    int i = 0;
+    int gt = n;
+    while (i < gt) {
+      int c = char_at(&keys[i], d, field);
+      if (c < pivot)
+        swap_keys(keys, lt++, i++);
+      else if (c > pivot)
+        swap_keys(keys, i, --gt);
+      else
+        i++;
+    }
+
+    mkqs(keys, lt, d, depth - 1, fieldNo, field);
+    mkqs(keys + gt, n - gt, d, depth - 1, fieldNo, field);
+
+    // The equal part is sorted by the next character, unless its strings ended.
+    // It has the same depth, the field length bounds its descent
+    if (pivot == 0)
+      return;
+    keys += lt;
+    n = gt - lt;
+    d++;
+  }
+  key_sort(keys, n, fieldNo, NULL);
+}
+
+// Sorts keys[0..n-1] by the string field fieldNo (1 to 3)
+void multikey_quicksort(SortKey* keys, int n, int fieldNo) {
+  FieldInfo field;
+  field.offset = string_field_offset(fieldNo);
+  field.size = (int)string_field_size(fieldNo);
+
+  // Depth limit of the smaller/greater splits, like introsort
+  int depth = 0;
+  for (int m = n; m > 1; m /= 2)
+    depth += 2;
+  mkqs(keys, n, 0, depth, fieldNo, &field);
+}
@@ -0,0 +1,212 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "key_sort.h"
+#include "reduce.h"
+#include "group_sort.h"
+#include "parallel_runs.h"
+
+/*
+ * Multi-threaded phase 1 of SR_SortedFile
+ * The buffer blocks of the groups are split into one slot per worker
+ * thread, so every group (and initial run) is (bufferSize-1)/threads blocks
+ * long. The calling thread does all the BF calls: it hands the slots out
+ * round robin, and while the workers sort their groups it writes back the
+ * groups that are done and reads the next ones from the input. The workers
+ * only touch the data of the blocks of their slot, which stay pinned until
+ * they are done.
+ */
+
+#define CHK_BF_ERR(call)      \
+  {                           \
+    BF_ErrorCode code = call; \
+    if (code != BF_OK) {      \
+      BF_PrintError(code);    \
+      return SR_ERROR;        \
+    }                         \
+  }
+
+typedef enum WorkerState {
+  WORKER_IDLE,
+  WORKER_BUSY,
+  WORKER_EXIT
+} WorkerState;
+
+typedef struct SortWorker {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  WorkerState state;
+  GroupSorter sorter;
+  BF_Block** blocks;   // the slot of the worker in the buffer blocks
+  char** buff_data;
+  int group_blocks;    // blocks of the group in the slot (0 if the slot is empty)
+  int run;             // run of the group in the list
+  int result;          // records sorted (after the reduction), -1 on error
+} SortWorker;
+
+static void* sort_worker_main(void* arg) {
+  SortWorker* worker = arg;
+  pthread_mutex_lock(&worker->lock);
+  while (1) {
+    while (worker->state == WORKER_IDLE)
+      pthread_cond_wait(&worker->cond, &worker->lock);
+    if (worker->state == WORKER_EXIT)
+      break;
+
+    // Sort without holding the lock, the group belongs to this worker now
+    pthread_mutex_unlock(&worker->lock);
+    int result = group_sorter_sort(&worker->sorter, worker->buff_data, worker->group_blocks);
+    pthread_mutex_lock(&worker->lock);
+
+    worker->result = result;
+    worker->state = WORKER_IDLE;
+    pthread_cond_broadcast(&worker->cond);
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return NULL;
+}
+
+static void wait_for_worker(SortWorker* worker) {
+  pthread_mutex_lock(&worker->lock);
+  while (worker->state == WORKER_BUSY)
+    pthread_cond_wait(&worker->cond, &worker->lock);
+  pthread_mutex_unlock(&worker->lock);
+}
+
+// Writes back the sorted group of an idle worker's slot (if any)
+// A reduced group is shorter than the run added for it, so the run is fixed here
+static SR_ErrorCode empty_slot(SortWorker* worker, RunList* runs) {
+  if (worker->group_blocks == 0)
+    return SR_OK;
+  int group_blocks = worker->group_blocks;
+  worker->group_blocks = 0;
+  // Dirty and unpin
+  for (int i = 0; i < group_blocks; i++) {
+    BF_Block_SetDirty(worker->blocks[i]);
+    CHK_BF_ERR(BF_UnpinBlock(worker->blocks[i]));
+  }
+  if (worker->result < 0)
+    return SR_ERROR;
+  runs->runs[worker->run].rec_num = worker->result;
+  return SR_OK;
+}
+
+// Loads the next group of the input into an empty slot, adds its run and
+// wakes the worker up. Sets *group_blocks to 0 if the input is exhausted
+static SR_ErrorCode fill_slot(SortWorker* worker, RunReader* input, int temp_fileDesc,
+                              int slot_blocks, int normalize, int first_block,
+                              int* group_blocks, RunList* runs) {
+  *group_blocks = group_load(input, temp_fileDesc, worker->blocks, worker->buff_data,
+                             slot_blocks, normalize);
+  if (*group_blocks < 0)
+    return SR_ERROR;
+  if (*group_blocks == 0)
+    return SR_OK;
+
+  int tot_records = 0;
+  for (int i = 0; i < *group_blocks; i++) {
+    int buff_recs = 0;
+    memcpy(&buff_recs, worker->buff_data[i], sizeof(int));
+    tot_records += buff_recs;
+  }
+  // Without its run the group is still written back by empty_slot, which fails then
+  worker->group_blocks = *group_blocks;
+  if (run_list_add(runs, first_block*sr_records_per_block(), tot_records) != 0) {
+    worker->result = -1;
+    return SR_ERROR;
+  }
+  worker->run = runs->run_num - 1;
+
+  pthread_mutex_lock(&worker->lock);
+  worker->state = WORKER_BUSY;
+  pthread_cond_broadcast(&worker->cond);
+  pthread_mutex_unlock(&worker->lock);
+  return SR_OK;
+}
+
+// Reads the rest of the input into the empty temp file in groups of
+// group_blocks/threads blocks, sorts them with up to threads worker threads
+// and adds a run for every group. The slots use buff_blocks[0..group_blocks-1]
+// If reduce is not NULL every group is reduced after it is sorted
+SR_ErrorCode parallel_sort_groups(RunReader* input, int temp_fileDesc, int normalize,
+                                  int group_blocks, int threads, SR_GroupSort group_sort,
+                                  int fieldNo, RecordCmp cmp, const void* cmp_ctx,
+                                  const Reducer* reduce, BF_Block** buff_blocks, RunList* runs) {
+  if (threads > group_blocks)
+    threads = group_blocks;
+  const int slot_blocks = group_blocks / threads;
+
+  SortWorker* workers = calloc(threads, sizeof(SortWorker));
+  if (workers == NULL)
+    return SR_ERROR;
+
+  // Start the workers
+  SR_ErrorCode ret = SR_OK;
+  int started = 0;
+  for (; started < threads; started++) {
+    SortWorker* worker = &workers[started];
+    worker->state = WORKER_IDLE;
+    worker->blocks = buff_blocks + started*slot_blocks;
+    worker->group_blocks = 0;
+    worker->buff_data = malloc(slot_blocks * sizeof(char*));
+    if (worker->buff_data == NULL ||
+        group_sorter_init(&worker->sorter, group_sort, fieldNo, cmp, cmp_ctx, reduce,
+                          slot_blocks) != 0) {
+      free(worker->buff_data);
+      ret = SR_ERROR;
+      break;
+    }
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    if (pthread_create(&worker->thread, NULL, sort_worker_main, worker) != 0) {
+      pthread_mutex_destroy(&worker->lock);
+      pthread_cond_destroy(&worker->cond);
+      group_sorter_destroy(&worker->sorter);
+      free(worker->buff_data);
+      ret = SR_ERROR;
+      break;
+    }
+  }
+
+  // Hand the groups out to the slots round robin
+  int group = 0;
+  int first_block = 0;
+  int loaded = 1;
+  while (ret == SR_OK && loaded > 0) {
+    SortWorker* worker = &workers[group % threads];
+    wait_for_worker(worker);
+    ret = empty_slot(worker, runs);
+    if (ret == SR_OK)
+      ret = fill_slot(worker, input, temp_fileDesc, slot_blocks, normalize, first_block,
+                      &loaded, runs);
+    first_block += loaded;
+    group++;
+  }
+
+  // Write back the last groups and stop the workers
+  for (int i = 0; i < started; i++) {
+    SortWorker* worker = &workers[i];
+    wait_for_worker(worker);
+    if (empty_slot(worker, runs) != SR_OK)
+      ret = SR_ERROR;
+
+    pthread_mutex_lock(&worker->lock);
+    worker->state = WORKER_EXIT;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+    pthread_join(worker->thread, NULL);
+
+    pthread_mutex_destroy(&worker->lock);
+    pthread_cond_destroy(&worker->cond);
+    group_sorter_destroy(&worker->sorter);
+    free(worker->buff_data);
+  }
+  free(workers);
+  return ret;
+}
@@ -0,0 +1,57 @@
+#include <string.h>
+
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "key_sort.h"
+#include "radix_sort.h"
+
+/*
+ * LSD radix sort of the key/pointer array of a group when sorting by id
+ * (fieldNo == 0). The id is kept sign-flipped in the upper 32 bits of the
+ * prefix (see key_sort.c), so sorting those bits as an unsigned number puts
+ * negative ids first. The 4 passes of 8 bits are stable counting sorts,
+ * and a pass is skipped when all keys have the same digit.
+ */
+
+// Sorts keys[0..n-1] by the upper 32 bits of their prefix
+// tmp must have room for n keys
+void radix_sort_keys(SortKey* keys, SortKey* tmp, int n) {
+  int counts[4][256];
+  memset(counts, 0, sizeof(counts));
+
+  // One pass over the keys builds the histograms of all 4 digits
+  for (int i = 0; i < n; i++) {
+    unsigned int key = (unsigned int)(keys[i].prefix >> 32);
+    counts[0][key & 0xFF]++;
+    counts[1][(key >> 8) & 0xFF]++;
+    counts[2][(key >> 16) & 0xFF]++;
+    counts[3][key >> 24]++;
+  }
+
+  SortKey* src = keys;
+  SortKey* dst = tmp;
+  for (int digit = 0; digit < 4; digit++) {
+    int shift = 32 + 8*digit;
+    // Every key has the same digit, the pass would not move anything
+    if (n == 0 || counts[digit][(src[0].prefix >> shift) & 0xFF] == n)
+      continue;
+
+    // Turn the counts into starting positions
+    int offset = 0;
+    for (int d = 0; d < 256; d++) {
+      int count = counts[digit][d];
+      counts[digit][d] = offset;
+      offset += count;
+    }
+    for (int i = 0; i < n; i++)
+      dst[counts[digit][(src[i].prefix >> shift) & 0xFF]++] = src[i];
+
+    SortKey* t = src;
+    src = dst;
+    dst = t;
+  }
+
+  // After an odd number of passes the sorted keys are in tmp
+  if (src != keys)
+    memcpy(keys, src, n * sizeof(SortKey));
+}
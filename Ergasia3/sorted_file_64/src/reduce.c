@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "reduce.h"
+
+// Makes an input record the aggregate of itself
+void reduce_start(const Reducer* reducer, Record* record) {
+  if (reducer->reduce == SR_REDUCE_COUNT)
+    record->id = 1;
+}
+
+// Adds the aggregate record to the aggregate acc of the same group
+void reduce_combine(const Reducer* reducer, Record* acc, const Record* record) {
+  switch (reducer->reduce) {
+    case SR_REDUCE_COUNT:
+      acc->id += record->id;
+      break;
+    case SR_REDUCE_MIN_ID:
+      if (record->id < acc->id)
+        *acc = *record;
+      break;
+    case SR_REDUCE_MAX_ID:
+      if (record->id > acc->id)
+        *acc = *record;
+      break;
+    default:
+      // Duplicates are dropped, the first one is kept
+      break;
+  }
+}
+
+// Reduces the sorted records of block_num blocks (buff_data) in place. The
+// aggregates are packed at the start of the group, sr_records_per_block() per block,
+// and the blocks after the last one are left empty
+// Returns the number of records left
+int reduce_group(const Reducer* reducer, char** buff_data, int block_num) {
+  const int recs_per_block = sr_records_per_block();
+  int out_block = 0;  // position of the next aggregate
+  int out_slot = 0;
+  int out_num = 0;
+  Record* acc = NULL;
+  // The aggregates are never written past the record being read
+  for (int i = 0; i < block_num; i++) {
+    int rec_num = 0;
+    memcpy(&rec_num, buff_data[i], sizeof(int));
+    Record* records = (Record*)(buff_data[i] + sizeof(int));
+    for (int j = 0; j < rec_num; j++) {
+      reduce_start(reducer, &records[j]);
+      if (acc != NULL && reducer->cmp(acc, &records[j], reducer->cmp_ctx) == 0) {
+        reduce_combine(reducer, acc, &records[j]);
+        continue;
+      }
+      if (out_slot == recs_per_block) {
+        out_block++;
+        out_slot = 0;
+      }
+      acc = (Record*)(buff_data[out_block] + sizeof(int)) + out_slot;
+      if (acc != &records[j])
+        *acc = records[j];
+      out_slot++;
+      out_num++;
+    }
+  }
+
+  // Record counters
+  for (int i = 0; i < block_num; i++) {
+    int rec_num = (i < out_block) ? recs_per_block : (i == out_block) ? out_slot : 0;
+    memcpy(buff_data[i], &rec_num, sizeof(int));
+  }
+  return out_num;
+}
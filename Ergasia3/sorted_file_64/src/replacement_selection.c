@@ -0,0 +1,159 @@
+#include <stdlib.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "reduce.h"
+#include "replacement_selection.h"
+
+/*
+ * Replacement selection run generation (phase 1 of SR_SortedFile)
+ * The records of the input file are streamed through a heap that holds as
+ * many records as fit in bufferSize-2 blocks (one block is left for reading
+ * the input and one for writing the runs, or bufferSize-3 with write-behind,
+ * where the block written last is still pinned). The smallest record of the heap
+ * is written to the current run and replaced by the next input record,
+ * which joins the current run if it is not smaller than the record just
+ * written, or else waits in the heap for the next run. On random input the
+ * runs are about twice as long as the memory, while sorted input produces
+ * a single run.
+ */
+
+typedef struct HeapEntry {
+  int run;  // run the record belongs to
+  int slot; // position of the record in the workspace
+} HeapEntry;
+
+static int entry_less(const HeapEntry* a, const HeapEntry* b,
+                      const Record* workspace, RecordCmp cmp, const void* cmp_ctx) {
+  if (a->run != b->run)
+    return a->run < b->run;
+  return cmp(&workspace[a->slot], &workspace[b->slot], cmp_ctx) < 0;
+}
+
+static void sift_down(HeapEntry* heap, int heap_size, int i,
+                      const Record* workspace, RecordCmp cmp, const void* cmp_ctx) {
+  HeapEntry entry = heap[i];
+  while (2*i + 1 < heap_size) {
+    int child = 2*i + 1;
+    if (child + 1 < heap_size && entry_less(&heap[child + 1], &heap[child], workspace, cmp, cmp_ctx))
+      child++;
+    if (!entry_less(&heap[child], &entry, workspace, cmp, cmp_ctx))
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = entry;
+}
+
+// Reads every record of the input file (blocks 1 and on) and writes the runs
+// into the temp file, which must be empty, in the order of cmp (with its
+// context cmp_ctx). The runs are added to the list
+// If normalize is set the string fields are zero padded as they are read
+// If behind is not NULL the full run blocks are written by its helper
+// If reduce is not NULL the equal records of every run are reduced as they are written
+SR_ErrorCode replacement_selection(int input_fileDesc, int temp_fileDesc, RecordCmp cmp,
+                                   const void* cmp_ctx, int normalize, int bufferSize, BF_Block** buff_blocks,
+                                   WriteBehind* behind, const Reducer* reduce, RunList* runs) {
+  int input_block_num;
+  if (BF_GetBlockCounter(input_fileDesc, &input_block_num) != BF_OK)
+    return SR_ERROR;
+
+  const int heap_blocks = (behind != NULL) ? bufferSize - 3 : bufferSize - 2;
+  const int capacity = heap_blocks * sr_records_per_block();
+  Record* workspace = malloc(capacity * sizeof(Record));
+  HeapEntry* heap = malloc(capacity * sizeof(HeapEntry));
+  if (workspace == NULL || heap == NULL) {
+    free(workspace);
+    free(heap);
+    return SR_ERROR;
+  }
+
+  SR_ErrorCode ret = SR_OK;
+  RunReader reader;
+  BlockWriter writer;
+  block_writer_open_behind(&writer, temp_fileDesc, buff_blocks[1], buff_blocks[2], behind, 0, 1);
+  writer.reduce = reduce;
+  if (run_reader_open(&reader, input_fileDesc, buff_blocks[0], 1, input_block_num, 0, -1) != SR_OK) {
+    free(workspace);
+    free(heap);
+    return SR_ERROR;
+  }
+
+  // Fill the heap with the first records, they all belong to the first run
+  int heap_size = 0;
+  Record* next;
+  while (heap_size < capacity && (next = run_reader_current(&reader)) != NULL) {
+    workspace[heap_size] = *next;
+    if (normalize)
+      record_normalize(&workspace[heap_size]);
+    if (reduce != NULL)
+      reduce_start(reduce, &workspace[heap_size]);
+    heap[heap_size].run = 0;
+    heap[heap_size].slot = heap_size;
+    heap_size++;
+    if (run_reader_next(&reader) != SR_OK) {
+      ret = SR_ERROR;
+      break;
+    }
+  }
+  for (int i = heap_size/2 - 1; i >= 0; i--)
+    sift_down(heap, heap_size, i, workspace, cmp, cmp_ctx);
+
+  int current_run = 0;
+  int run_first_rec = 0;
+  while (ret == SR_OK && heap_size > 0) {
+    HeapEntry top = heap[0];
+    // The smallest record belongs to the next run, so the current one is over
+    if (top.run != current_run) {
+      if (block_writer_end_run(&writer) != SR_OK ||
+          run_list_add(runs, run_first_rec, writer.written - run_first_rec) != 0) {
+        ret = SR_ERROR;
+        break;
+      }
+      current_run = top.run;
+      run_first_rec = writer.written;
+    }
+    if (block_writer_put(&writer, &workspace[top.slot]) != SR_OK) {
+      ret = SR_ERROR;
+      break;
+    }
+
+    next = run_reader_current(&reader);
+    if (next != NULL) {
+      Record incoming = *next;
+      if (normalize)
+        record_normalize(&incoming);
+      if (reduce != NULL)
+        reduce_start(reduce, &incoming);
+      // Smaller records than the one just written have to wait for the next run
+      if (cmp(&incoming, &workspace[top.slot], cmp_ctx) < 0)
+        heap[0].run = current_run + 1;
+      workspace[top.slot] = incoming;
+      if (run_reader_next(&reader) != SR_OK)
+        ret = SR_ERROR;
+    }
+    else {
+      heap_size--;
+      heap[0] = heap[heap_size];
+    }
+    sift_down(heap, heap_size, 0, workspace, cmp, cmp_ctx);
+  }
+
+  if (ret == SR_OK && block_writer_end_run(&writer) != SR_OK)
+    ret = SR_ERROR;
+  if (ret == SR_OK && writer.written > run_first_rec)
+    if (run_list_add(runs, run_first_rec, writer.written - run_first_rec) != 0)
+      ret = SR_ERROR;
+
+  if (run_reader_close(&reader) != SR_OK)
+    ret = SR_ERROR;
+  if (ret == SR_OK)
+    ret = block_writer_close(&writer);
+  if (ret != SR_OK)
+    block_writer_abort(&writer);
+  free(workspace);
+  free(heap);
+  return ret;
+}
@@ -0,0 +1,599 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "sparse_index.h"
+#include "reduce.h"
+
+// The prebuilt libbf.so has fixed sizes and no BF_GetBlockSize/BF_GetBufferSize,
+// so they are weak references that are NULL when linked against it
+#pragma weak BF_GetBlockSize
+#pragma weak BF_GetBufferSize
+#pragma weak BF_WriteBlock
+
+int sr_block_size() {
+  return (BF_GetBlockSize != NULL) ? BF_GetBlockSize() : BF_BLOCK_SIZE;
+}
+
+int sr_buffer_size() {
+  return (BF_GetBufferSize != NULL) ? BF_GetBufferSize() : BF_BUFFER_SIZE;
+}
+
+// The block size is set once at BF_Init, so every thread gets the same value
+int sr_records_per_block() {
+  return (int)((sr_block_size() - sizeof(int)) / sizeof(Record));
+}
+
+// The BF layer is not thread safe, so readers and writers of different
+// threads (parallel final merge) take turns in it through this lock
+static pthread_mutex_t bf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHK_BF_LOCKED(call)          \
+  {                                  \
+    pthread_mutex_lock(&bf_lock);    \
+    BF_ErrorCode code = call;        \
+    pthread_mutex_unlock(&bf_lock);  \
+    if (code != BF_OK) {             \
+      BF_PrintError(code);           \
+      return SR_ERROR;               \
+    }                                \
+  }
+
+void run_list_init(RunList* list) {
+  list->runs = NULL;
+  list->run_num = 0;
+  list->capacity = 0;
+}
+
+// Appends a run to the list (grows it when needed)
+// Returns 0 on success, -1 if memory could not be allocated
+int run_list_add(RunList* list, int first_rec, int rec_num) {
+  if (list->run_num == list->capacity) {
+    int new_capacity = (list->capacity == 0) ? 16 : 2*list->capacity;
+    Run* new_runs = realloc(list->runs, new_capacity * sizeof(Run));
+    if (new_runs == NULL)
+      return -1;
+    list->runs = new_runs;
+    list->capacity = new_capacity;
+  }
+  list->runs[list->run_num].first_rec = first_rec;
+  list->runs[list->run_num].rec_num = rec_num;
+  list->run_num++;
+  return 0;
+}
+
+void run_list_destroy(RunList* list) {
+  free(list->runs);
+  run_list_init(list);
+}
+
+/*
+ * Read-ahead
+ * While the merge consumes the current block of a reader, the helper thread
+ * pins the next one into the second handle of the reader. When the current
+ * block runs out the two handles are swapped, and the helper is asked to
+ * unpin the old block and read the one after the new. Every reader has at
+ * most one request queued, so the queue needs a slot per reader.
+ */
+
+struct ReadAhead {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;    // a request was queued or served, or the helper must stop
+  RunReader** queue;      // circular queue of requests
+  int* retire;            // the request also unpins the block in the next handle
+  int capacity;
+  int head;
+  int count;
+  int stop;
+};
+
+// Serves a request: unpins the previous block if asked and pins the next one
+static SR_ErrorCode read_ahead_fetch(RunReader* reader, int retire) {
+  if (retire)
+    CHK_BF_LOCKED(BF_UnpinBlock(reader->next));
+  CHK_BF_LOCKED(BF_GetBlock(reader->fileDesc, reader->block_num + 1, reader->next));
+  return SR_OK;
+}
+
+static void* read_ahead_main(void* arg) {
+  ReadAhead* ahead = arg;
+  pthread_mutex_lock(&ahead->lock);
+  while (1) {
+    while (ahead->count == 0 && !ahead->stop)
+      pthread_cond_wait(&ahead->cond, &ahead->lock);
+    // Requests queued before the stop are still served
+    if (ahead->count == 0)
+      break;
+    RunReader* reader = ahead->queue[ahead->head];
+    int retire = ahead->retire[ahead->head];
+    ahead->head = (ahead->head + 1) % ahead->capacity;
+    ahead->count--;
+
+    pthread_mutex_unlock(&ahead->lock);
+    SR_ErrorCode result = read_ahead_fetch(reader, retire);
+    pthread_mutex_lock(&ahead->lock);
+    reader->next_result = result;
+    reader->next_done = 1;
+    pthread_cond_broadcast(&ahead->cond);
+  }
+  pthread_mutex_unlock(&ahead->lock);
+  return NULL;
+}
+
+// Starts a helper for up to max_readers readers, NULL on failure
+ReadAhead* read_ahead_create(int max_readers) {
+  ReadAhead* ahead = malloc(sizeof(ReadAhead));
+  if (ahead == NULL)
+    return NULL;
+  ahead->queue = malloc(max_readers * sizeof(RunReader*));
+  ahead->retire = malloc(max_readers * sizeof(int));
+  ahead->capacity = max_readers;
+  ahead->head = 0;
+  ahead->count = 0;
+  ahead->stop = 0;
+  pthread_mutex_init(&ahead->lock, NULL);
+  pthread_cond_init(&ahead->cond, NULL);
+  if (ahead->queue == NULL || ahead->retire == NULL ||
+      pthread_create(&ahead->thread, NULL, read_ahead_main, ahead) != 0) {
+    free(ahead->queue);
+    free(ahead->retire);
+    free(ahead);
+    return NULL;
+  }
+  return ahead;
+}
+
+// Serves the queued requests and stops the helper
+void read_ahead_destroy(ReadAhead* ahead) {
+  pthread_mutex_lock(&ahead->lock);
+  ahead->stop = 1;
+  pthread_cond_broadcast(&ahead->cond);
+  pthread_mutex_unlock(&ahead->lock);
+  pthread_join(ahead->thread, NULL);
+  pthread_mutex_destroy(&ahead->lock);
+  pthread_cond_destroy(&ahead->cond);
+  free(ahead->queue);
+  free(ahead->retire);
+  free(ahead);
+}
+
+static void read_ahead_queue(ReadAhead* ahead, RunReader* reader, int retire) {
+  pthread_mutex_lock(&ahead->lock);
+  int tail = (ahead->head + ahead->count) % ahead->capacity;
+  ahead->queue[tail] = reader;
+  ahead->retire[tail] = retire;
+  ahead->count++;
+  reader->next_requested = 1;
+  reader->next_done = 0;
+  pthread_cond_broadcast(&ahead->cond);
+  pthread_mutex_unlock(&ahead->lock);
+}
+
+// Waits until the requested block of the reader is pinned
+static SR_ErrorCode read_ahead_wait(RunReader* reader) {
+  ReadAhead* ahead = reader->ahead;
+  pthread_mutex_lock(&ahead->lock);
+  while (!reader->next_done)
+    pthread_cond_wait(&ahead->cond, &ahead->lock);
+  pthread_mutex_unlock(&ahead->lock);
+  return reader->next_result;
+}
+
+// Requests the block after the current one if the reader will need it
+// If retire is set the next handle still has the previous block pinned
+static SR_ErrorCode run_reader_request_next(RunReader* reader, int retire) {
+  int needed = reader->block_num + 1 < reader->end_block &&
+               (reader->remaining < 0 || reader->remaining > reader->recs_in_block - reader->rec_i);
+  if (needed) {
+    read_ahead_queue(reader->ahead, reader, retire);
+    return SR_OK;
+  }
+  reader->next_requested = 0;
+  if (retire)
+    CHK_BF_LOCKED(BF_UnpinBlock(reader->next));
+  return SR_OK;
+}
+
+// Copies the data of a block and unpins it (called with the lock held)
+static BF_ErrorCode read_block_copy(int fileDesc, int block_num, BF_Block* block, char* copy) {
+  BF_ErrorCode code = BF_GetBlock(fileDesc, block_num, block);
+  if (code != BF_OK)
+    return code;
+  memcpy(copy, BF_Block_GetData(block), sr_block_size());
+  return BF_UnpinBlock(block);
+}
+
+// Unpins the block of the reader, a copying reader has none pinned
+static SR_ErrorCode run_reader_unpin(RunReader* reader) {
+  if (reader->copy == NULL)
+    CHK_BF_LOCKED(BF_UnpinBlock(reader->block));
+  return SR_OK;
+}
+
+static SR_ErrorCode run_reader_unpin_next(RunReader* reader) {
+  CHK_BF_LOCKED(BF_UnpinBlock(reader->next));
+  return SR_OK;
+}
+
+// Pins the first block (from block_num on) that has a record at rec_i
+static SR_ErrorCode run_reader_load(RunReader* reader) {
+  reader->records = NULL;
+  while (reader->block_num < reader->end_block) {
+    char* data;
+    if (reader->copy != NULL) {
+      // Keep the records in the copy and give the block back at once, without
+      // letting another thread unpin it in between
+      CHK_BF_LOCKED(read_block_copy(reader->fileDesc, reader->block_num, reader->block, reader->copy));
+      data = reader->copy;
+    }
+    else {
+      CHK_BF_LOCKED(BF_GetBlock(reader->fileDesc, reader->block_num, reader->block));
+      data = BF_Block_GetData(reader->block);
+    }
+    memcpy(&reader->recs_in_block, data, sizeof(int));
+    if (reader->rec_i < reader->recs_in_block) {
+      reader->records = (Record*)(data + sizeof(int));
+      if (reader->ahead != NULL)
+        return run_reader_request_next(reader, 0);
+      return SR_OK;
+    }
+    // Empty block, move on to the next one
+    if (run_reader_unpin(reader) != SR_OK)
+      return SR_ERROR;
+    reader->block_num++;
+    reader->rec_i = 0;
+  }
+  return SR_OK;
+}
+
+// Moves to the block after the current, consumed one
+static SR_ErrorCode run_reader_advance(RunReader* reader) {
+  if (!reader->next_requested) {
+    if (run_reader_unpin(reader) != SR_OK)
+      return SR_ERROR;
+    reader->block_num++;
+    reader->rec_i = 0;
+    return run_reader_load(reader);
+  }
+
+  // The next block was read ahead, so the handles swap places
+  if (read_ahead_wait(reader) != SR_OK)
+    return SR_ERROR;
+  BF_Block* consumed = reader->block;
+  reader->block = reader->next;
+  reader->next = consumed;
+  reader->block_num++;
+  reader->rec_i = 0;
+  char* data = BF_Block_GetData(reader->block);
+  memcpy(&reader->recs_in_block, data, sizeof(int));
+  reader->records = (Record*)(data + sizeof(int));
+  if (reader->recs_in_block == 0) {
+    // Empty block, move on without reading ahead
+    reader->next_requested = 0;
+    CHK_BF_LOCKED(BF_UnpinBlock(reader->next));
+    return run_reader_advance(reader);
+  }
+  return run_reader_request_next(reader, 1);
+}
+
+static SR_ErrorCode run_reader_start(RunReader* reader, int fileDesc, BF_Block* block,
+                                     char* copy, BF_Block* next, ReadAhead* ahead,
+                                     int first_block, int end_block, int first_slot,
+                                     int rec_num) {
+  reader->fileDesc = fileDesc;
+  reader->block = block;
+  reader->copy = copy;
+  reader->ahead = ahead;
+  reader->next = next;
+  reader->next_requested = 0;
+  reader->next_done = 0;
+  reader->next_result = SR_OK;
+  reader->records = NULL;
+  reader->block_num = first_block;
+  reader->end_block = end_block;
+  reader->rec_i = first_slot;
+  reader->recs_in_block = 0;
+  reader->remaining = rec_num;
+  if (rec_num == 0)
+    return SR_OK;
+  return run_reader_load(reader);
+}
+
+SR_ErrorCode run_reader_open(RunReader* reader, int fileDesc, BF_Block* block,
+                             int first_block, int end_block, int first_slot, int rec_num) {
+  return run_reader_start(reader, fileDesc, block, NULL, NULL, NULL, first_block, end_block,
+                          first_slot, rec_num);
+}
+
+// Like run_reader_open, but if copy is not NULL (sr_block_size() bytes) every block
+// is copied there and unpinned at once. The BF layer does not count the pins of a
+// block, so readers of different threads that may meet in the same block use copies
+SR_ErrorCode run_reader_open_copy(RunReader* reader, int fileDesc, BF_Block* block, char* copy,
+                                  int first_block, int end_block, int first_slot, int rec_num) {
+  return run_reader_start(reader, fileDesc, block, copy, NULL, NULL, first_block, end_block,
+                          first_slot, rec_num);
+}
+
+// Like run_reader_open, but if ahead is not NULL the next block of the run is
+// pinned into the handle next by the helper while the current one is consumed
+SR_ErrorCode run_reader_open_ahead(RunReader* reader, int fileDesc, BF_Block* block,
+                                   BF_Block* next, ReadAhead* ahead, int first_block,
+                                   int end_block, int first_slot, int rec_num) {
+  return run_reader_start(reader, fileDesc, block, NULL, next, ahead, first_block, end_block,
+                          first_slot, rec_num);
+}
+
+// Moves to the next record, unpinning the current block once it is consumed
+SR_ErrorCode run_reader_next(RunReader* reader) {
+  if (reader->records == NULL)
+    return SR_OK;
+  reader->rec_i++;
+  if (reader->remaining > 0)
+    reader->remaining--;
+
+  if (reader->remaining == 0) {
+    reader->records = NULL;
+    return run_reader_unpin(reader);
+  }
+  else if (reader->rec_i == reader->recs_in_block) {
+    return run_reader_advance(reader);
+  }
+  return SR_OK;
+}
+
+// Moves a reader at the start of a block, that reads to end_block, blocks blocks on
+SR_ErrorCode run_reader_skip_blocks(RunReader* reader, int blocks) {
+  if (reader->records == NULL)
+    return SR_OK;
+  if (run_reader_unpin(reader) != SR_OK)
+    return SR_ERROR;
+  reader->block_num += blocks;
+  reader->rec_i = 0;
+  return run_reader_load(reader);
+}
+
+// Unpins the block of a reader that was not read to the end
+// After an error it still unpins whatever the reader has pinned
+SR_ErrorCode run_reader_close(RunReader* reader) {
+  SR_ErrorCode ret = SR_OK;
+  if (reader->next_requested) {
+    reader->next_requested = 0;
+    // A failed read left nothing pinned in the next handle
+    if (read_ahead_wait(reader) != SR_OK)
+      ret = SR_ERROR;
+    else if (run_reader_unpin_next(reader) != SR_OK)
+      ret = SR_ERROR;
+  }
+  if (reader->records != NULL) {
+    reader->records = NULL;
+    if (run_reader_unpin(reader) != SR_OK)
+      ret = SR_ERROR;
+  }
+  return ret;
+}
+
+/*
+ * Write-behind
+ * A writer with write-behind hands every full block to the helper thread
+ * and goes on filling the next block through its second handle. The helper
+ * writes the block with BF_WriteBlock, outside the lock, so the write runs
+ * while the writer (and the readers of a merge) use the BF layer, and then
+ * unpins it. Only one block is written at a time. The prebuilt library has
+ * no BF_WriteBlock, so sort_through_temp only creates the helper with the
+ * source BF layer.
+ */
+
+struct WriteBehind {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;    // a block was handed over or written, or the helper must stop
+  BF_Block* block;        // block to write, NULL when the helper is idle
+  SR_ErrorCode result;    // SR_ERROR once a write has failed
+  int stop;
+};
+
+// The block is unpinned even if it could not be written, so the file can be closed
+static SR_ErrorCode write_behind_write(BF_Block* block) {
+  SR_ErrorCode ret = SR_OK;
+  if (BF_WriteBlock(block) != BF_OK)
+    ret = SR_ERROR;
+  CHK_BF_LOCKED(BF_UnpinBlock(block));
+  return ret;
+}
+
+static void* write_behind_main(void* arg) {
+  WriteBehind* behind = arg;
+  pthread_mutex_lock(&behind->lock);
+  while (1) {
+    while (behind->block == NULL && !behind->stop)
+      pthread_cond_wait(&behind->cond, &behind->lock);
+    if (behind->block == NULL)
+      break;
+    BF_Block* block = behind->block;
+
+    pthread_mutex_unlock(&behind->lock);
+    SR_ErrorCode result = write_behind_write(block);
+    pthread_mutex_lock(&behind->lock);
+    if (result != SR_OK)
+      behind->result = SR_ERROR;
+    behind->block = NULL;
+    pthread_cond_broadcast(&behind->cond);
+  }
+  pthread_mutex_unlock(&behind->lock);
+  return NULL;
+}
+
+// Starts a helper, NULL on failure
+WriteBehind* write_behind_create() {
+  WriteBehind* behind = malloc(sizeof(WriteBehind));
+  if (behind == NULL)
+    return NULL;
+  behind->block = NULL;
+  behind->result = SR_OK;
+  behind->stop = 0;
+  pthread_mutex_init(&behind->lock, NULL);
+  pthread_cond_init(&behind->cond, NULL);
+  if (pthread_create(&behind->thread, NULL, write_behind_main, behind) != 0) {
+    free(behind);
+    return NULL;
+  }
+  return behind;
+}
+
+// Writes the block handed over last and stops the helper
+void write_behind_destroy(WriteBehind* behind) {
+  pthread_mutex_lock(&behind->lock);
+  behind->stop = 1;
+  pthread_cond_broadcast(&behind->cond);
+  pthread_mutex_unlock(&behind->lock);
+  pthread_join(behind->thread, NULL);
+  pthread_mutex_destroy(&behind->lock);
+  pthread_cond_destroy(&behind->cond);
+  free(behind);
+}
+
+// Waits until the helper is idle, returns SR_ERROR if a write has failed
+static SR_ErrorCode write_behind_wait(WriteBehind* behind) {
+  pthread_mutex_lock(&behind->lock);
+  while (behind->block != NULL)
+    pthread_cond_wait(&behind->cond, &behind->lock);
+  SR_ErrorCode result = behind->result;
+  pthread_mutex_unlock(&behind->lock);
+  return result;
+}
+
+// Hands a full, pinned block to the helper once it has written the previous one
+static SR_ErrorCode write_behind_put(WriteBehind* behind, BF_Block* block) {
+  if (write_behind_wait(behind) != SR_OK)
+    return SR_ERROR;
+  pthread_mutex_lock(&behind->lock);
+  behind->block = block;
+  pthread_cond_broadcast(&behind->cond);
+  pthread_mutex_unlock(&behind->lock);
+  return SR_OK;
+}
+
+void block_writer_open(BlockWriter* writer, int fileDesc, BF_Block* block,
+                       int first_block, int allocate) {
+  block_writer_open_behind(writer, fileDesc, block, NULL, NULL, first_block, allocate);
+}
+
+// Like block_writer_open, but if behind is not NULL the full blocks are written and
+// unpinned by the helper, while the writer fills the next one through the handle spare
+void block_writer_open_behind(BlockWriter* writer, int fileDesc, BF_Block* block,
+                              BF_Block* spare, WriteBehind* behind, int first_block,
+                              int allocate) {
+  writer->fileDesc = fileDesc;
+  writer->block = block;
+  writer->spare = spare;
+  writer->behind = behind;
+  writer->data = NULL;
+  writer->block_num = first_block;
+  writer->rec_num = 0;
+  writer->recs_per_block = sr_records_per_block();
+  writer->allocate = allocate;
+  writer->written = 0;
+  writer->index = NULL;
+  writer->reduce = NULL;
+  writer->has_pending = 0;
+}
+
+// Writes the record counter of the pinned block, dirties and unpins it
+static SR_ErrorCode block_writer_flush(BlockWriter* writer) {
+  memcpy(writer->data, &writer->rec_num, sizeof(int));
+  BF_Block_SetDirty(writer->block);
+  if (writer->behind != NULL) {
+    if (write_behind_put(writer->behind, writer->block) != SR_OK)
+      return SR_ERROR;
+    BF_Block* full = writer->block;
+    writer->block = writer->spare;
+    writer->spare = full;
+  }
+  else {
+    CHK_BF_LOCKED(BF_UnpinBlock(writer->block));
+  }
+  writer->data = NULL;
+  writer->rec_num = 0;
+  writer->block_num++;
+  return SR_OK;
+}
+
+static SR_ErrorCode block_writer_append(BlockWriter* writer, const Record* record) {
+  // Only pin the next block when there is a record to put in it
+  if (writer->data == NULL) {
+    if (writer->allocate)
+      CHK_BF_LOCKED(BF_AllocateBlock(writer->fileDesc, writer->block))
+    else
+      CHK_BF_LOCKED(BF_GetBlock(writer->fileDesc, writer->block_num, writer->block))
+    writer->data = BF_Block_GetData(writer->block);
+    if (writer->index != NULL && sparse_index_set(writer->index, writer->block_num, record) != 0)
+      return SR_ERROR;
+  }
+
+  memcpy(writer->data + sizeof(int) + writer->rec_num*sizeof(Record), record, sizeof(Record));
+  writer->rec_num++;
+  writer->written++;
+
+  if (writer->rec_num == writer->recs_per_block)
+    return block_writer_flush(writer);
+  return SR_OK;
+}
+
+// Writes a record, or with a reducer combines it with the previous records
+// if they are equal. The aggregate is written when a different record comes
+// or the run ends, so written only counts the aggregates written so far
+SR_ErrorCode block_writer_put(BlockWriter* writer, const Record* record) {
+  if (writer->reduce == NULL)
+    return block_writer_append(writer, record);
+  if (writer->has_pending) {
+    if (writer->reduce->cmp(&writer->pending, record, writer->reduce->cmp_ctx) == 0) {
+      reduce_combine(writer->reduce, &writer->pending, record);
+      return SR_OK;
+    }
+    if (block_writer_append(writer, &writer->pending) != SR_OK)
+      return SR_ERROR;
+  }
+  writer->pending = *record;
+  writer->has_pending = 1;
+  return SR_OK;
+}
+
+// Writes the aggregate of the last records put, so the next records start a
+// new run (nothing to do without a reducer)
+SR_ErrorCode block_writer_end_run(BlockWriter* writer) {
+  if (!writer->has_pending)
+    return SR_OK;
+  writer->has_pending = 0;
+  return block_writer_append(writer, &writer->pending);
+}
+
+// Flushes the last, partially filled block
+// With write-behind it also waits until every block is written and unpinned
+SR_ErrorCode block_writer_close(BlockWriter* writer) {
+  if (block_writer_end_run(writer) != SR_OK)
+    return SR_ERROR;
+  if (writer->data != NULL && block_writer_flush(writer) != SR_OK)
+    return SR_ERROR;
+  if (writer->behind != NULL)
+    return write_behind_wait(writer->behind);
+  return SR_OK;
+}
+
+// Gives a writer up after an error (also after a failed block_writer_close):
+// waits for the helper and unpins the block being filled without writing it
+void block_writer_abort(BlockWriter* writer) {
+  writer->has_pending = 0;
+  if (writer->behind != NULL)
+    write_behind_wait(writer->behind);
+  if (writer->data != NULL) {
+    pthread_mutex_lock(&bf_lock);
+    BF_UnpinBlock(writer->block);
+    pthread_mutex_unlock(&bf_lock);
+    writer->data = NULL;
+  }
+}
@@ -1,11 +1,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "bf.h"
 #include "sort_file.h"
 #include "sr_utils.h"
-#include "block_quicksort.h"
+#include "loser_tree.h"
+#include "run_io.h"
+#include "sparse_index.h"
+#include "merge.h"
+#include "replacement_selection.h"
+#include "key_sort.h"
+#include "group_sort.h"
+#include "parallel_runs.h"
+#include "top_k.h"
+#include "merge_join.h"
+#include "reduce.h"
+
+// Only the source BF layer maps files, SR_OpenFileMapped falls back to BF_OpenFile
+#pragma weak BF_OpenFileMapped
+// and has access hints, without them the files are used with no hint
+#pragma weak BF_SetFileHint
+#pragma weak BF_GetFileHint
+// and opens files with O_DIRECT
+#pragma weak BF_OpenFileDirect
+// and writes a block outside the lock, without it there is no write-behind
+#pragma weak BF_WriteBlock
+
+// Position of the block size in the first block of a sort file, after ".sf"
+#define SF_BLOCK_SIZE_OFFSET 4
+
+// Most runs the final merge splits across threads
+#define PARALLEL_MERGE_MAX_RUNS 64
 
 #define CHK_BF_ERR(call)      \
   {                           \
@@ -16,6 +43,22 @@
     }                         \
   }
 
+// Like CHK_BF_ERR, for the functions that release what they hold at their
+// cleanup label (their ret is SR_ERROR until they succeed)
+#define CHK_BF_CLEANUP(call)  \
+  {                           \
+    BF_ErrorCode code = call; \
+    if (code != BF_OK) {      \
+      BF_PrintError(code);    \
+      goto cleanup;           \
+    }                         \
+  }
+
+static void set_file_hint(int fileDesc, BF_AccessHint hint) {
+  if (BF_SetFileHint != NULL)
+    BF_SetFileHint(fileDesc, hint);
+}
+
 SR_ErrorCode SR_Init() {
   // Your code goes here
   return SR_OK;
@@ -35,6 +78,11 @@ SR_ErrorCode SR_CreateFile(const char *fileName) {
   char* block_data = BF_Block_GetData(block);
   char sf_id[4] = ".sf";
   memcpy(block_data, sf_id, strlen(sf_id) + 1);
+  // and the block size it was created with
+  int block_size = sr_block_size();
+  memcpy(block_data + SF_BLOCK_SIZE_OFFSET, &block_size, sizeof(int));
+  // and no sparse index, a sort writes one into its output
+  memset(block_data + SF_INDEX_OFFSET, 0, 4*sizeof(int));
 
   // Dirty and unpin
   BF_Block_SetDirty(block);
@@ -48,37 +96,63 @@ SR_ErrorCode SR_CreateFile(const char *fileName) {
 
 
 
-SR_ErrorCode SR_OpenFile(const char *fileName, int *fileDesc) {
+static SR_ErrorCode open_sort_file(const char *fileName, int mapped, int *fileDesc) {
   // Open file
   int tmp_fd = 0;
-  CHK_BF_ERR(BF_OpenFile(fileName, &tmp_fd));
+  if (mapped && BF_OpenFileMapped != NULL)
+    CHK_BF_ERR(BF_OpenFileMapped(fileName, &tmp_fd))
+  else
+    CHK_BF_ERR(BF_OpenFile(fileName, &tmp_fd));
+  // A file that is not a sort file is closed again
+  SR_ErrorCode ret = SR_ERROR;
+  BF_Block* block;
+  BF_Block_Init(&block);
+
   // Check if there is a block in the file
   int block_num;
-  CHK_BF_ERR(BF_GetBlockCounter(tmp_fd, &block_num));
+  CHK_BF_CLEANUP(BF_GetBlockCounter(tmp_fd, &block_num));
   if (block_num == 0) {
     printf("Error: File %s is not a sort file\n", fileName);
-    return SR_ERROR;
+    goto cleanup;
   }
 
   // Else check if its a sort file
-  BF_Block* block;
-  BF_Block_Init(&block);
   // There should be an ".sf" at the start of the first block
-  CHK_BF_ERR(BF_GetBlock(tmp_fd, 0, block));
+  CHK_BF_CLEANUP(BF_GetBlock(tmp_fd, 0, block));
   char* block_data = BF_Block_GetData(block);
-  if (strcmp(block_data, ".sf") != 0) {
+  // The blocks of the file must have the size of the blocks of the BF layer
+  // (files without a recorded block size have the default one)
+  int block_size;
+  memcpy(&block_size, block_data + SF_BLOCK_SIZE_OFFSET, sizeof(int));
+  if (block_size == 0)
+    block_size = BF_BLOCK_SIZE;
+  if (strcmp(block_data, ".sf") != 0)
     printf("Error: File %s is not a sort file\n", fileName);
+  else if (block_size != sr_block_size())
+    printf("Error: File %s has blocks of %d bytes, but the BF layer uses %d\n",
+           fileName, block_size, sr_block_size());
+  else
+    ret = SR_OK;
+  // Unpin block
+  CHK_BF_CLEANUP(BF_UnpinBlock(block));
+
+cleanup:
+  BF_Block_Destroy(&block);
+  if (ret != SR_OK) {
+    BF_CloseFile(tmp_fd);
     return SR_ERROR;
   }
-
   // Assign the fileDesc value
   *fileDesc = tmp_fd;
+  return SR_OK;
+}
 
-  // Unpin and destroy block
-  CHK_BF_ERR(BF_UnpinBlock(block));
-  BF_Block_Destroy(&block);
+SR_ErrorCode SR_OpenFile(const char *fileName, int *fileDesc) {
+  return open_sort_file(fileName, 0, fileDesc);
+}
 
-  return SR_OK;
+SR_ErrorCode SR_OpenFileMapped(const char *fileName, int *fileDesc) {
+  return open_sort_file(fileName, 1, fileDesc);
 }
 
 
@@ -125,7 +199,7 @@ SR_ErrorCode SR_InsertEntry(int fileDesc,	Record record) {
     // Check if there is enough space for a new record in
     // the current block
     int used_space = sizeof(int) + rec_num*sizeof(Record);
-    if (BF_BLOCK_SIZE - used_space >= sizeof(Record)) {
+    if (rec_num < sr_records_per_block()) {
       // Increment and update rec_num metadata
       rec_num++;
       memcpy(block_data, &rec_num, sizeof(int));
@@ -163,549 +237,671 @@ SR_ErrorCode SR_InsertEntry(int fileDesc,	Record record) {
   return SR_OK;
 }
 
-SR_ErrorCode SR_SortedFile(
-  const char* input_filename,
-  const char* output_filename,
-  int fieldNo,
-  int bufferSize
-) {
+SR_ErrorCode SR_OpenAppender(int fileDesc, SR_Appender *appender) {
+  appender->fileDesc = fileDesc;
+  appender->data = NULL;
+  appender->rec_num = 0;
+  appender->normalize = 0;
+  BF_Block_Init(&appender->block);
 
-  // Check for invalid bufferSize and fieldNo
-  if (bufferSize < 3 || bufferSize > BF_BUFFER_SIZE)
-    return SR_ERROR;
-  if (fieldNo < 0 || fieldNo > 3)
-    return SR_ERROR;
-
-  // Use SR_OpenFile to open the input sort file (only uses 1 block, unpins and destroys it after)
-  int input_fileDesc = -1;
-  SR_OpenFile(input_filename, &input_fileDesc);
-  // Get the number of blocks in the input file
-  int input_file_block_number;
-  CHK_BF_ERR(BF_GetBlockCounter(input_fileDesc, &input_file_block_number));
-  // Create and open a temp file
-  char* temp_filename = "temp";
-  CHK_BF_ERR(BF_CreateFile(temp_filename));
-  int temp_fileDesc = -1;
-  CHK_BF_ERR(BF_OpenFile(temp_filename, &temp_fileDesc));
-
-  // Buffers and initialization
-  BF_Block* buff_blocks[bufferSize];
-  char* buff_data[bufferSize];
-  for (int i = 0; i < bufferSize; i++)
-    BF_Block_Init(&buff_blocks[i]);
-
-  // Then copy each block of the input file into the temporary one (only uses 2 buffer blocks)
-  for (int i = 1; i < input_file_block_number; i++) {
-    // Get block of input file
-    CHK_BF_ERR(BF_GetBlock(input_fileDesc, i, buff_blocks[0]));
-    buff_data[0] = BF_Block_GetData(buff_blocks[0]);
-    // Create block into the temp file
-    CHK_BF_ERR(BF_AllocateBlock(temp_fileDesc, buff_blocks[1]));
-    buff_data[1] = BF_Block_GetData(buff_blocks[1]);
-    // Copy data
-    memcpy(buff_data[1], buff_data[0], BF_BLOCK_SIZE);
-    // Dirty and unpin
-    BF_Block_SetDirty(buff_blocks[1]);
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[0]));
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[1]));
-  }
-
-  const int temp_block_num = input_file_block_number - 1;
-  // Main while loop (for step 1, quicksort)
-  // Sort blocks in groups of bufferSize
-  int curr_group = 0;
-  while (bufferSize + curr_group*bufferSize < temp_block_num) {
-    // Load blocks into buffers
-
-    for (int i = 0; i < bufferSize; i++) {
-      CHK_BF_ERR(BF_GetBlock(temp_fileDesc, curr_group*bufferSize + i, buff_blocks[i]));
-      buff_data[i] = BF_Block_GetData(buff_blocks[i]);
-    }
-
-    // Get total number of records in the buffers
-    int tot_records = 0;
-    for (int i = 0; i < bufferSize; i++) {
-      int buff_recs = 0;
-      memcpy(&buff_recs, buff_data[i], sizeof(int));
-      tot_records += buff_recs;
-    }
-    // Call quicksort
-    int low = 0;
-    int high = tot_records - 1;
-    block_quicksort(buff_data, fieldNo, low, high);
-    // Dirty and unpin
-    for (int i = 0; i < bufferSize; i++) {
-      BF_Block_SetDirty(buff_blocks[i]);
-      CHK_BF_ERR(BF_UnpinBlock(buff_blocks[i]));
+  // Keep the last block pinned if it has room for more records
+  int block_num;
+  CHK_BF_ERR(BF_GetBlockCounter(fileDesc, &block_num));
+  if (block_num > 1) {
+    CHK_BF_ERR(BF_GetBlock(fileDesc, block_num - 1, appender->block));
+    char* block_data = BF_Block_GetData(appender->block);
+    int rec_num;
+    memcpy(&rec_num, block_data, sizeof(int));
+    if (rec_num < sr_records_per_block()) {
+      appender->data = block_data;
+      appender->rec_num = rec_num;
     }
-
-    // Move on to the next group
-    curr_group++;
-  }
-
-  // Now call quicksort for the remaining blocks
-  int rem_block_num = temp_block_num % bufferSize;
-  // May also be the last bufferSize number of blocks
-  if (rem_block_num == 0)
-    rem_block_num = bufferSize;
-
-  // Load remaining blocks into buffers
-  for (int i = 0; i < rem_block_num; i++) {
-    CHK_BF_ERR(BF_GetBlock(temp_fileDesc, curr_group*bufferSize + i, buff_blocks[i]));
-    buff_data[i] = BF_Block_GetData(buff_blocks[i]);
-  }
-  // Load blocks into buffers
-  for (int i = 0; i < rem_block_num; i++) {
-    CHK_BF_ERR(BF_GetBlock(temp_fileDesc, curr_group*bufferSize + i, buff_blocks[i]));
-    buff_data[i] = BF_Block_GetData(buff_blocks[i]);
-  }
-  // Get total number of records in the buffers
-  int tot_records = 0;
-  for (int i = 0; i < rem_block_num; i++) {
-    int buff_recs = 0;
-    memcpy(&buff_recs, buff_data[i], sizeof(int));
-    tot_records += buff_recs;
-  }
-  // Call quicksort
-  int low = 0;
-  int high = tot_records - 1;
-  block_quicksort(buff_data, fieldNo, low, high);
-  // Dirty and unpin
-  for (int i = 0; i < rem_block_num; i++) {
-    BF_Block_SetDirty(buff_blocks[i]);
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[i]));
-  }
-
-  // Check if bufferSize is greater than the number of blocks in the input file
-  // in that case, step 2 is not needed
-  if (bufferSize >= temp_block_num) {
-    // Create the sorted, output file
-    SR_CreateFile(output_filename);
-    int output_fileDesc = 0;
-    // Open it and copy temp_file contents
-    SR_OpenFile(output_filename, &output_fileDesc);
-    for (int i = 0; i < temp_block_num; i++) {
-      // Get block of temp file
-      CHK_BF_ERR(BF_GetBlock(temp_fileDesc, i, buff_blocks[0]));
-      buff_data[0] = BF_Block_GetData(buff_blocks[0]);
-
-      // Create a symmetric block into the output file
-      CHK_BF_ERR(BF_AllocateBlock(output_fileDesc, buff_blocks[1]));
-      buff_data[1] = BF_Block_GetData(buff_blocks[1]);
-
-      // Copy data
-      memcpy(buff_data[1], buff_data[0], sizeof(int));
-
-      // Dirty and unpin
-      BF_Block_SetDirty(buff_blocks[1]);
-      CHK_BF_ERR(BF_UnpinBlock(buff_blocks[0]));
-      CHK_BF_ERR(BF_UnpinBlock(buff_blocks[1]));
+    else {
+      CHK_BF_ERR(BF_UnpinBlock(appender->block));
     }
-
-    // End program
-    // Destroy blocks
-    for (int i=0; i < bufferSize; i++)
-      BF_Block_Destroy(&buff_blocks[i]);
-    // Close files
-    SR_CloseFile(input_fileDesc);
-    CHK_BF_ERR(BF_CloseFile(temp_fileDesc));
-    SR_CloseFile(output_fileDesc);
-    // Delete temp file
-    remove(temp_filename);
-    return SR_OK;
-
   }
+  return SR_OK;
+}
 
-
-
-  ////////////////Part 2//////////////////
-
-
-  //the temp file will have two times the Blocks of the original file
-  //we know that so we will allocate them now
-  //we wont need to create anymore
-  //and beacuse of the way we use them this will simplify the process
-
-  // Create another temp_block_num number of blocks in the temp file with the same
-  // number of records in them
-  for (int i=0; i < temp_block_num; i++) {
-    // Get block of temp file
-    CHK_BF_ERR(BF_GetBlock(temp_fileDesc, i, buff_blocks[0]));
-    buff_data[0] = BF_Block_GetData(buff_blocks[0]);
-
-    // Create a symmetric block into the temp file
-    CHK_BF_ERR(BF_AllocateBlock(temp_fileDesc, buff_blocks[1]));
-    buff_data[1] = BF_Block_GetData(buff_blocks[1]);
-
-    // Copy data
-    memcpy(buff_data[1], buff_data[0], sizeof(int));
-
-    // Dirty and unpin
-    BF_Block_SetDirty(buff_blocks[1]);
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[0]));
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[1]));
+SR_ErrorCode SR_Append(SR_Appender *appender, const Record *record) {
+  // Allocate another block when the last one is full
+  if (appender->data == NULL) {
+    CHK_BF_ERR(BF_AllocateBlock(appender->fileDesc, appender->block));
+    appender->data = BF_Block_GetData(appender->block);
+    appender->rec_num = 0;
   }
 
-
-
-  const int blocks_to_output = temp_block_num;
-
-  int j=0;//helps as pass the groups we saw
-  int blocks_in_group=bufferSize; //the next block group will be that far and the block groups will have that many blocks
-
-  int num_of_block_groups = blocks_to_output/bufferSize;//number of groups
-  if(blocks_to_output % bufferSize != 0)
-    num_of_block_groups = num_of_block_groups + 1;
-    //if there is an incomplete group count it as a whole
-
-  int number_of_merges = num_of_block_groups/(bufferSize-1);
-  if (num_of_block_groups%(bufferSize-1) != 0)
-    number_of_merges++;
-
-  int groups_remain = num_of_block_groups;
-  int fl=0;                     //depending on the number we see at the begining or at the middle of temp_file
-  int block_index[bufferSize]; //the number (index) of the block we have at the buffer
-  int new_group_num;
-
-  int block_index_in_group[bufferSize];   //how many we passed in group
-  int rec_index_in_block[bufferSize];    //how many records we passed in block
-  int tot_recs_in_block[bufferSize];    //how many records does a block have
-
-  int tot_blocks_in_group[bufferSize-1]; //how many blocks a group has
-                                        //the last group might have less
-  int buffers_needed_for_merge[number_of_merges]; //how many buffers we need for the merge (buffersize-1 or less)
-  int current_merge = 0;  //how many merges so far/
-
-  Record* record_data[bufferSize];
-
-
-  for (int i = 0; i < number_of_merges; i++) {
-    if ((i == number_of_merges-1) && (num_of_block_groups % (bufferSize-1) != 0))
-      buffers_needed_for_merge[i] = num_of_block_groups % (bufferSize-1);
-    else
-      buffers_needed_for_merge[i] = bufferSize-1;
+  // Insert record and update the rec_num metadata
+  Record* slot = (Record*)(appender->data + sizeof(int)) + appender->rec_num;
+  memcpy(slot, record, sizeof(Record));
+  // Zero pad the string fields, if this appender normalizes its records
+  if (appender->normalize)
+    record_normalize(slot);
+  appender->rec_num++;
+  memcpy(appender->data, &appender->rec_num, sizeof(int));
+
+  // Dirty and unpin the block once it is full
+  if (appender->rec_num == sr_records_per_block()) {
+    BF_Block_SetDirty(appender->block);
+    CHK_BF_ERR(BF_UnpinBlock(appender->block));
+    appender->data = NULL;
   }
+  return SR_OK;
+}
 
-  while (num_of_block_groups > bufferSize-1) {
-
-    for (int i = 0; i < buffers_needed_for_merge[current_merge]; i++) {
-      if ((current_merge == number_of_merges - 1) && (i == buffers_needed_for_merge[current_merge] - 1))
-        tot_blocks_in_group[i] = blocks_to_output - ((num_of_block_groups-1)*blocks_in_group);
-      else
-        tot_blocks_in_group[i] = blocks_in_group;
-    }
-
-
-    // Take the first block from the first block groups using only buffers actually needed for the merge
-    for (int i = 0; i < buffers_needed_for_merge[current_merge]; i++) {
-      block_index[i] = blocks_to_output*fl + blocks_in_group*(i+j);
-      CHK_BF_ERR(BF_GetBlock(temp_fileDesc, block_index[i], buff_blocks[i]));
-      buff_data[i] = BF_Block_GetData(buff_blocks[i]);
-    }
-
-    if(groups_remain == num_of_block_groups) {//starting block for sorting
-      if(fl == 0) {
-        block_index[bufferSize-1] = blocks_to_output;
-        CHK_BF_ERR(BF_GetBlock(temp_fileDesc, block_index[bufferSize-1], buff_blocks[bufferSize-1]));
-        buff_data[bufferSize-1] = BF_Block_GetData(buff_blocks[bufferSize-1]);
-
-        memcpy(&tot_recs_in_block[bufferSize-1], buff_data[bufferSize-1], sizeof(int));
-        block_index_in_group[bufferSize-1] = 0;
-        rec_index_in_block[bufferSize-1] = 0;
-        record_data[bufferSize-1] = buff_data[bufferSize-1] + sizeof(int);
-
-      }
-      else {
-        block_index[bufferSize-1] = 0;
-        CHK_BF_ERR(BF_GetBlock(temp_fileDesc , block_index[bufferSize-1], buff_blocks[bufferSize-1]));
-        buff_data[bufferSize-1] = BF_Block_GetData(buff_blocks[bufferSize-1]);
-
-        memcpy(&tot_recs_in_block[bufferSize-1], buff_data[bufferSize-1], sizeof(int));
-        block_index_in_group[bufferSize-1] = 0;
-        rec_index_in_block[bufferSize-1] = 0;
-        record_data[bufferSize-1] = buff_data[bufferSize-1] + sizeof(int);
-      }
-    }
+SR_ErrorCode SR_CloseAppender(SR_Appender *appender) {
+  if (appender->data != NULL) {
+    BF_Block_SetDirty(appender->block);
+    CHK_BF_ERR(BF_UnpinBlock(appender->block));
+    appender->data = NULL;
+  }
+  BF_Block_Destroy(&appender->block);
+  return SR_OK;
+}
 
-    // Initialization for normal buffers may be fewer than bufferSize-1!!!!
-    for (int i = 0; i < buffers_needed_for_merge[current_merge]; i++) {
-      memcpy(&tot_recs_in_block[i], buff_data[i], sizeof(int));
-      block_index_in_group[i] = 0;
-      rec_index_in_block[i] = 0;
-      record_data[i] = buff_data[i] + sizeof(int);
+SR_ErrorCode SR_InsertEntries(int fileDesc, const Record *records, int count) {
+  SR_Appender appender;
+  if (SR_OpenAppender(fileDesc, &appender) != SR_OK)
+    return SR_ERROR;
+  for (int i = 0; i < count; i++)
+    if (SR_Append(&appender, &records[i]) != SR_OK) {
+      // Unpin the last block and free the handle, keeping what was appended
+      SR_CloseAppender(&appender);
+      return SR_ERROR;
     }
+  return SR_CloseAppender(&appender);
+}
 
-    int no_more_recs = 0;
-    while(!no_more_recs) {
-      // Find min record value
-      int min_record_i = -1;
-      for (int buff_i = 0; buff_i < buffers_needed_for_merge[current_merge]; buff_i++) {
-        if (block_index_in_group[buff_i] < tot_blocks_in_group[buff_i]) {
-
-          if(min_record_i == -1 ||
-              record_cmp(fieldNo, record_data[buff_i][rec_index_in_block[buff_i]],
-                        record_data[min_record_i][rec_index_in_block[min_record_i]]) < 0){
-
-                          min_record_i = buff_i;
-          }
-        }
-      }
-
-      // Copy the whole record to bufferSize-1 (output block)
-      record_data[bufferSize-1][rec_index_in_block[bufferSize-1]]
-        = record_data[min_record_i][rec_index_in_block[min_record_i]];
+void SR_SortOptions_Init(SR_SortOptions *options) {
+  options->run_generation = SR_RUNS_LOAD_AND_SORT;
+  options->group_sort = SR_SORT_AUTO;
+  options->normalize_keys = 0;
+  options->threads = 1;
+  options->read_ahead = 0;
+  options->write_behind = 0;
+  options->spill_dir = NULL;
+  options->direct_io = 0;
+  options->reduce = SR_REDUCE_NONE;
+}
 
+// Phase 1 of the default run generation
+// Reads the input records straight into newly allocated blocks at the end of dest_fileDesc
+// (normalized if normalize is set), bufferSize-1 blocks at a time, and sorts them in place.
+// Every sorted group becomes a run. The last buffer block is used to read the input
+// With more than one thread the groups are sorted concurrently (see parallel_runs.c)
+// The records are sorted by cmp, called with its context cmp_ctx
+// If index is not NULL it gets the first record of every sorted block
+// If reduce is not NULL every group is reduced after it is sorted
+static SR_ErrorCode load_and_sort_runs(
+  int input_fileDesc,
+  int dest_fileDesc,
+  int fieldNo,
+  RecordCmp cmp,
+  const void* cmp_ctx,
+  int normalize,
+  int bufferSize,
+  SR_GroupSort group_sort,
+  int threads,
+  const Reducer* reduce,
+  BF_Block** buff_blocks,
+  SparseIndex* index,
+  RunList* runs
+) {
+  const int max_group_blocks = bufferSize - 1;
+  char* buff_data[max_group_blocks];
 
-      // We passed one record from one buffer
-      rec_index_in_block[min_record_i]++;
-      // If there are no other records in the block of the min record, move to the next block
-      if (rec_index_in_block[min_record_i] == tot_recs_in_block[min_record_i]) {
-        // Unpin previous block
-        CHK_BF_ERR(BF_UnpinBlock(buff_blocks[min_record_i]));
-        // Get next block
-        block_index[min_record_i]++;
-        block_index_in_group[min_record_i]++;
+  // Get the number of blocks in the input file and the destination file
+  int input_file_block_number;
+  CHK_BF_ERR(BF_GetBlockCounter(input_fileDesc, &input_file_block_number));
+  int first_block;
+  CHK_BF_ERR(BF_GetBlockCounter(dest_fileDesc, &first_block));
 
-        // If not, do not get next block (instead search in the other buffers)
-        if (block_index_in_group[min_record_i] < tot_blocks_in_group[min_record_i]) {
-          CHK_BF_ERR(BF_GetBlock(temp_fileDesc, block_index[min_record_i], buff_blocks[min_record_i]));
+  RunReader reader;
+  if (run_reader_open(&reader, input_fileDesc, buff_blocks[max_group_blocks], 1,
+                      input_file_block_number, 0, -1) != SR_OK)
+    return SR_ERROR;
 
-          rec_index_in_block[min_record_i] = 0;
+  // A single group gains nothing from the workers
+  // The reader is closed on every path, so the input file can be closed after an error
+  if (threads > 1 && input_file_block_number - 1 > max_group_blocks) {
+    SR_ErrorCode ret = parallel_sort_groups(&reader, dest_fileDesc, normalize, max_group_blocks, threads,
+                                            group_sort, fieldNo, cmp, cmp_ctx, reduce,
+                                            buff_blocks, runs);
+    if (run_reader_close(&reader) != SR_OK)
+      ret = SR_ERROR;
+    return ret;
+  }
 
-          buff_data[min_record_i] = BF_Block_GetData(buff_blocks[min_record_i]);
-          memcpy(&tot_recs_in_block[min_record_i], buff_data[min_record_i], sizeof(int));
-          record_data[min_record_i] = buff_data[min_record_i] + sizeof(int);
-        }
-      }
+  GroupSorter sorter;
+  if (group_sorter_init(&sorter, group_sort, fieldNo, cmp, cmp_ctx, reduce,
+                        max_group_blocks) != 0) {
+    run_reader_close(&reader);
+    return SR_ERROR;
+  }
 
-      // Now preform check to see if there are more records to copy
-      no_more_recs = 1;
-      for (int buff_i = 0; buff_i < buffers_needed_for_merge[current_merge]; buff_i++)
-        if (block_index_in_group[buff_i] < tot_blocks_in_group[buff_i])
-          no_more_recs = 0;
-
-      // We passed one record in the output block
-      rec_index_in_block[bufferSize-1]++;
-      // Check if output buffer is full (get next block)
-      if (rec_index_in_block[bufferSize-1] == tot_recs_in_block[bufferSize-1]) {
-        // Dirty and Unpin previous block
-        BF_Block_SetDirty(buff_blocks[bufferSize-1]);
-        CHK_BF_ERR(BF_UnpinBlock(buff_blocks[bufferSize-1]));
-
-        // Get next block
-        block_index[bufferSize-1]++;
-        block_index_in_group[bufferSize-1]++;//we passed one block
-        // Only if its in bounds
-        if (block_index[bufferSize-1] < 2*blocks_to_output - blocks_to_output*fl) {
-          CHK_BF_ERR(BF_GetBlock(temp_fileDesc, block_index[bufferSize-1], buff_blocks[bufferSize-1]));
-
-          rec_index_in_block[bufferSize-1] = 0;
-
-          buff_data[bufferSize-1] = BF_Block_GetData(buff_blocks[bufferSize-1]);
-          memcpy(&tot_recs_in_block[bufferSize-1], buff_data[bufferSize-1], sizeof(int));
-          record_data[bufferSize-1] = buff_data[bufferSize-1] + sizeof(int);
-        }
+  // Main loop (for step 1, quicksort)
+  // Sort blocks in groups of bufferSize-1 (the last group may have fewer blocks)
+  SR_ErrorCode ret = SR_OK;
+  int group_blocks = 0;
+  while (ret == SR_OK && (group_blocks = group_load(&reader, dest_fileDesc, buff_blocks,
+                                                    buff_data, max_group_blocks,
+                                                    normalize)) > 0) {
+    int tot_records = group_sorter_sort(&sorter, buff_data, group_blocks);
+    if (tot_records < 0)
+      ret = SR_ERROR;
+
+    // Dirty and unpin (every block, also after an error)
+    for (int i = 0; i < group_blocks; i++) {
+      int rec_num;
+      memcpy(&rec_num, buff_data[i], sizeof(int));
+      if (ret == SR_OK && index != NULL && rec_num > 0 &&
+          sparse_index_set(index, first_block + i, (Record*)(buff_data[i] + sizeof(int))) != 0)
+        ret = SR_ERROR;
+      BF_Block_SetDirty(buff_blocks[i]);
+      BF_ErrorCode code = BF_UnpinBlock(buff_blocks[i]);
+      if (code != BF_OK) {
+        BF_PrintError(code);
+        ret = SR_ERROR;
       }
+    }
 
-      // Now preform check to see if there are more records to copy
-      no_more_recs = 1;
-      for (int buff_i = 0; buff_i < buffers_needed_for_merge[current_merge]; buff_i++)
-        if (block_index_in_group[buff_i] < tot_blocks_in_group[buff_i])
-          no_more_recs = 0;
+    if (ret == SR_OK && run_list_add(runs, first_block*sr_records_per_block(), tot_records) != 0)
+      ret = SR_ERROR;
+    first_block += group_blocks;
+  }
+  if (group_blocks < 0)
+    ret = SR_ERROR;
 
+  group_sorter_destroy(&sorter);
+  if (run_reader_close(&reader) != SR_OK)
+    ret = SR_ERROR;
+  return ret;
+}
 
+// One pass of step 2: every max_fan_in consecutive runs of the half that starts
+// at src_base are merged into one run of the half that starts at dst_base
+// With read-ahead the next blocks of the runs are read into the max_fan_in
+// buffer blocks after the ones of the runs, and with write-behind the output
+// block being written is the second to last buffer block
+// Every merged run keeps only its first limit records (-1 for all), and is
+// reduced as it is written if reduce is not NULL
+static SR_ErrorCode merge_pass(
+  int temp_fileDesc,
+  int src_base,
+  int dst_base,
+  int half_block_num,
+  int bufferSize,
+  int max_fan_in,
+  BF_Block** buff_blocks,
+  ReadAhead* ahead,
+  WriteBehind* behind,
+  LoserTree* tree,
+  int limit,
+  const Reducer* reduce,
+  RunList* runs
+) {
+  // The merged runs are written one after the other, so the whole pass
+  // uses a single writer on the last buffer block
+  BlockWriter writer;
+  block_writer_open_behind(&writer, temp_fileDesc, buff_blocks[bufferSize-1],
+                           buff_blocks[bufferSize-2], behind, dst_base, 0);
+  writer.reduce = reduce;
+
+  int new_run_num = 0;
+  for (int first_run = 0; first_run < runs->run_num; first_run += max_fan_in) {
+    int k = runs->run_num - first_run;
+    if (k > max_fan_in)
+      k = max_fan_in;
+
+    int first_rec = writer.written;
+    if (merge_runs(temp_fileDesc, src_base, half_block_num, &runs->runs[first_run], k,
+                   buff_blocks, NULL, ahead, buff_blocks + max_fan_in, tree, limit,
+                   &writer) != SR_OK) {
+      block_writer_abort(&writer);
+      return SR_ERROR;
     }
 
+    // The merged run replaces the runs it came from (new_run_num <= first_run)
+    runs->runs[new_run_num].first_rec = first_rec;
+    runs->runs[new_run_num].rec_num = writer.written - first_rec;
+    new_run_num++;
+  }
+  runs->run_num = new_run_num;
 
-    groups_remain = groups_remain - buffers_needed_for_merge[current_merge];
+  if (block_writer_close(&writer) != SR_OK) {
+    block_writer_abort(&writer);
+    return SR_ERROR;
+  }
+  return SR_OK;
+}
 
-    if (groups_remain == 0) {
-      blocks_in_group *= bufferSize-1; //we merged bufferSize-1 groups with the same number of blocks AUTO EINAI TO GENIKO!! TO EIDIKO EINAI TO ARRAY int tot_blocks_in_group[bufferSize-1];
-      new_group_num = num_of_block_groups / (bufferSize-1);
+SR_ErrorCode SR_SortedFile(
+  const char* input_filename,
+  const char* output_filename,
+  int fieldNo,
+  int bufferSize
+) {
+  return SR_SortedFileWithOptions(input_filename, output_filename, fieldNo, bufferSize, NULL);
+}
 
-      if(num_of_block_groups%(bufferSize-1)!=0)
-        new_group_num = new_group_num + 1;//num_of_block_groups%(bufferSize-1);
+// Creates the temp file of a sort in the spill directory with a name no other sort
+// uses, opens it and removes the name at once, so the file is deleted when it is
+// closed or when the process ends
+static SR_ErrorCode open_spill_file(const SR_SortOptions* options, int* fileDesc) {
+  const char* dir = (options->spill_dir != NULL) ? options->spill_dir : ".";
+  char* filename = malloc(strlen(dir) + sizeof("/sr_spill_XXXXXX"));
+  if (filename == NULL)
+    return SR_ERROR;
+  sprintf(filename, "%s/sr_spill_XXXXXX", dir);
+  int os_fd = mkstemp(filename);
+  if (os_fd < 0) {
+    printf("Error: Cannot create a temp file in %s\n", dir);
+    free(filename);
+    return SR_ERROR;
+  }
+  close(os_fd);
+
+  BF_ErrorCode code;
+  if (options->direct_io && BF_OpenFileDirect != NULL)
+    code = BF_OpenFileDirect(filename, fileDesc);
+  else
+    code = BF_OpenFile(filename, fileDesc);
+  unlink(filename);
+  free(filename);
+  if (code != BF_OK) {
+    BF_PrintError(code);
+    return SR_ERROR;
+  }
+  return SR_OK;
+}
 
-      num_of_block_groups = new_group_num;  //the same here
-      groups_remain = num_of_block_groups; //we havent started merging the new groups yet
+// Sorts an input that does not fit in memory through the temp file: part 1 writes the
+// initial runs into it, the merge passes alternate between its two halves and the last
+// merge writes straight into the output file
+// Only the first limit records are merged and written (-1 for all)
+// If index is not NULL it gets the first record of every output block
+static SR_ErrorCode sort_through_temp(
+  int input_fileDesc,
+  int output_fileDesc,
+  int fieldNo,
+  RecordCmp cmp,
+  const void* cmp_ctx,
+  int bufferSize,
+  int limit,
+  const SR_SortOptions* options,
+  BF_Block** buff_blocks,
+  SparseIndex* index
+) {
+  // Everything acquired below is released at cleanup, on success and on error
+  SR_ErrorCode ret = SR_ERROR;
+  WriteBehind* behind = NULL;
+  ReadAhead* ahead = NULL;
+  LoserTree tree = { 0 };
+  RunList runs;
+  run_list_init(&runs);
 
-      j = 0;                               //we passed 0 so far
-      fl= (fl+1) % 2;                       //changes between 0 and 1
+  // Create and open a temp file
+  int temp_fileDesc = -1;
+  if (open_spill_file(options, &temp_fileDesc) != SR_OK)
+    goto cleanup;
+  // The runs are written and read in order, so the temp blocks are replaced first
+  set_file_hint(temp_fileDesc, BF_HINT_SEQUENTIAL);
+
+  // With write-behind the output of both parts takes two buffers, one for the
+  // block being filled and one for the block a helper thread writes meanwhile
+  // Without BF_WriteBlock the helper could only unpin the blocks, under the
+  // same lock as the writer, so the option is ignored
+  if (options->write_behind && bufferSize >= 4 && BF_WriteBlock != NULL) {
+    behind = write_behind_create();
+    if (behind == NULL)
+      goto cleanup;
+  }
 
-      current_merge = 0;
+  // Equal records are reduced in every part of the sort
+  Reducer reducer = { options->reduce, cmp, cmp_ctx };
+  const Reducer* reduce = (options->reduce != SR_REDUCE_NONE) ? &reducer : NULL;
+
+  ////////////////Part 1//////////////////
+
+  // Create the initial runs in the first half of the temp file
+  SR_ErrorCode phase1;
+  if (options->run_generation == SR_RUNS_REPLACEMENT_SELECTION)
+    phase1 = replacement_selection(input_fileDesc, temp_fileDesc, cmp, cmp_ctx,
+                                   options->normalize_keys, bufferSize, buff_blocks, behind,
+                                   reduce, &runs);
+  else
+    phase1 = load_and_sort_runs(input_fileDesc, temp_fileDesc, fieldNo, cmp, cmp_ctx,
+                                options->normalize_keys, bufferSize,
+                                options->group_sort, options->threads, reduce, buff_blocks,
+                                NULL, &runs);
+  if (phase1 != SR_OK)
+    goto cleanup;
+
+  // An empty input has no runs to merge, the output only gets its first block
+  if (runs.run_num == 0) {
+    ret = SR_OK;
+    goto cleanup;
+  }
 
-      int new_number_of_merges = number_of_merges / (bufferSize-1);
+  // Runs are stored packed, so the end of the last run decides the blocks of each half
+  // (reduced groups leave the rest of their blocks empty, so it is not the records)
+  const int recs_per_block = sr_records_per_block();
+  int half_block_num = 0;
+  for (int i = 0; i < runs.run_num; i++) {
+    int end_block = (runs.runs[i].first_rec + runs.runs[i].rec_num + recs_per_block - 1) /
+                    recs_per_block;
+    if (end_block > half_block_num)
+      half_block_num = end_block;
+  }
+  // The records of a run after its first limit ones cannot be in the output
+  if (limit >= 0)
+    for (int i = 0; i < runs.run_num; i++)
+      if (runs.runs[i].rec_num > limit)
+        runs.runs[i].rec_num = limit;
 
-      if (number_of_merges % (bufferSize-1) != 0)
-        new_number_of_merges++;
+  ////////////////Part 2//////////////////
 
-      number_of_merges = new_number_of_merges;
+  // bufferSize-1 buffers are used for the merge inputs and the last one as output buffer
+  // (bufferSize-2 and the last two with write-behind)
+  // With read-ahead the inputs take two buffers each, one for the block being
+  // merged and one for the next block, which a helper thread reads meanwhile
+  const int input_blocks = (behind != NULL) ? bufferSize - 2 : bufferSize - 1;
+  int max_fan_in = input_blocks;
+  if (options->read_ahead && input_blocks >= 4) {
+    max_fan_in = input_blocks / 2;
+    ahead = read_ahead_create(max_fan_in);
+    if (ahead == NULL)
+      goto cleanup;
+  }
+  if (loser_tree_init(&tree, max_fan_in, cmp, cmp_ctx) != 0)
+    goto cleanup;
+
+  // If more than one pass is needed the temp file will have two halves of
+  // half_block_num blocks, every pass reads the runs of one half and writes
+  // the merged runs into the other. We allocate the second half now
+  if (runs.run_num > max_fan_in) {
+    for (int i = 0; i < half_block_num; i++) {
+      CHK_BF_CLEANUP(BF_AllocateBlock(temp_fileDesc, buff_blocks[0]));
+      CHK_BF_CLEANUP(BF_UnpinBlock(buff_blocks[0]));
+    }
+  }
 
-      for (int i = 0; i < number_of_merges; i++) {
-        if ((i == number_of_merges-1) && (num_of_block_groups % (bufferSize-1) != 0))
-          buffers_needed_for_merge[i] = num_of_block_groups % (bufferSize-1);
-        else
-          buffers_needed_for_merge[i] = bufferSize-1;
-      }
+  int src_base = 0;
+  while (runs.run_num > max_fan_in) {
+    // Alternate between the two halves of the temp file
+    int dst_base = (src_base == 0) ? half_block_num : 0;
+    if (merge_pass(temp_fileDesc, src_base, dst_base, half_block_num, bufferSize, max_fan_in,
+                   buff_blocks, ahead, behind, &tree, limit, reduce, &runs) != SR_OK)
+      goto cleanup;
+    src_base = dst_base;
+  }
 
+  // Merge the remaining (at most max_fan_in) runs into the output file from block 1 onward
+  // Every thread of a parallel merge needs a buffer block per run and one for output
+  // Finding the split points costs about run_num^2 block reads per thread, so
+  // with big buffers the parallel merge is kept to a moderate number of runs
+  int merge_threads = options->threads;
+  if (merge_threads > bufferSize / (runs.run_num + 1))
+    merge_threads = bufferSize / (runs.run_num + 1);
+  // The parallel merge cuts the output by record counts, which a limit or a reduction changes
+  if (runs.run_num > PARALLEL_MERGE_MAX_RUNS || limit >= 0 || reduce != NULL)
+    merge_threads = 1;
+  if (merge_threads > 1 && half_block_num > 1) {
+    // The threads write their block ranges out of order, so the blocks must exist first
+    for (int i = 0; i < half_block_num; i++) {
+      CHK_BF_CLEANUP(BF_AllocateBlock(output_fileDesc, buff_blocks[0]));
+      CHK_BF_CLEANUP(BF_UnpinBlock(buff_blocks[0]));
     }
-
-    // Else j increases by bufferSize-1 in order to ignore the block groups that we saw before
-    else {
-      j = j + bufferSize-1;
-      current_merge++;
+    if (parallel_merge_runs(temp_fileDesc, src_base, half_block_num, runs.runs, runs.run_num,
+                            merge_threads, cmp, cmp_ctx, buff_blocks, output_fileDesc, 1,
+                            index) != SR_OK)
+      goto cleanup;
+  }
+  else {
+    // The output blocks are allocated as they are filled
+    BlockWriter writer;
+    block_writer_open_behind(&writer, output_fileDesc, buff_blocks[bufferSize-1],
+                             buff_blocks[bufferSize-2], behind, 1, 1);
+    writer.index = index;
+    writer.reduce = reduce;
+    if (merge_runs(temp_fileDesc, src_base, half_block_num, runs.runs, runs.run_num,
+                   buff_blocks, NULL, ahead, buff_blocks + max_fan_in, &tree, limit,
+                   &writer) != SR_OK ||
+        block_writer_close(&writer) != SR_OK) {
+      block_writer_abort(&writer);
+      goto cleanup;
     }
-
   }
+  ret = SR_OK;
+
+cleanup:
+  // The helpers are stopped first, they may still hold blocks of the temp file
+  if (ahead != NULL)
+    read_ahead_destroy(ahead);
+  if (behind != NULL)
+    write_behind_destroy(behind);
+  loser_tree_destroy(&tree);
+  run_list_destroy(&runs);
+  // Close the temp file, which deletes it
+  if (temp_fileDesc >= 0) {
+    BF_ErrorCode code = BF_CloseFile(temp_fileDesc);
+    if (code != BF_OK) {
+      BF_PrintError(code);
+      ret = SR_ERROR;
+    }
+  }
+  return ret;
+}
 
-  //Last merge create output file and put it there
-  int output_fileDesc;
-  //Create the sorted, output file
-  SR_CreateFile(output_filename);
-  SR_OpenFile(output_filename, &output_fileDesc);
-
-  // Create another blocks_to_output number of blocks in the output file with the same
-  // number of records in them
-  for (int i=0; i < blocks_to_output; i++) {
-    // Get block of temp file
-    CHK_BF_ERR(BF_GetBlock(temp_fileDesc, i, buff_blocks[0]));
-    buff_data[0] = BF_Block_GetData(buff_blocks[0]);
-
-    // Create a symmetric block into the temp file
-    CHK_BF_ERR(BF_AllocateBlock(output_fileDesc, buff_blocks[1]));
-    buff_data[1] = BF_Block_GetData(buff_blocks[1]);
+// Sorts the input file into the output file with the comparator cmp of fieldNo
+// (SORT_FIELD_KEYS for a sort by keys, with its KeySpec as cmp_ctx), shared by
+// both parts of the sort
+// Only the first limit records are written (-1 for all)
+static SR_ErrorCode sorted_file(
+  const char* input_filename,
+  const char* output_filename,
+  int fieldNo,
+  RecordCmp cmp,
+  const void* cmp_ctx,
+  int bufferSize,
+  int limit,
+  const SR_SortOptions* options
+) {
+  // Check for invalid bufferSize
+  if (bufferSize < 3 || bufferSize > sr_buffer_size())
+    return SR_ERROR;
+  if (options->threads < 1)
+    return SR_ERROR;
 
-    // Copy data
-    memcpy(buff_data[1], buff_data[0], sizeof(int));
+  // Buffers and initialization
+  // Everything acquired below is released at cleanup, on success and on error
+  BF_Block* buff_blocks[bufferSize];
+  for (int i = 0; i < bufferSize; i++)
+    BF_Block_Init(&buff_blocks[i]);
+  SR_ErrorCode ret = SR_ERROR;
+  int input_fileDesc = -1;
+  int output_fileDesc = -1;
+  SparseIndex index;
+  SparseIndex* output_index = NULL;
 
-    // Dirty and unpin
-    BF_Block_SetDirty(buff_blocks[1]);
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[0]));
-    CHK_BF_ERR(BF_UnpinBlock(buff_blocks[1]));
+  // Use SR_OpenFile to open the input sort file (only uses 1 block, unpins and destroys it after)
+  if (SR_OpenFile(input_filename, &input_fileDesc) != SR_OK)
+    goto cleanup;
+  int input_block_num;
+  CHK_BF_CLEANUP(BF_GetBlockCounter(input_fileDesc, &input_block_num));
+  // Create and open the sorted, output file
+  if (SR_CreateFile(output_filename) != SR_OK)
+    goto cleanup;
+  if (SR_OpenFile(output_filename, &output_fileDesc) != SR_OK)
+    goto cleanup;
+  // The input is read once, and the output written once, so the sort does not
+  // push out of the buffer the blocks of the other open files
+  set_file_hint(input_fileDesc, BF_HINT_EVICT_FIRST);
+  set_file_hint(output_fileDesc, BF_HINT_SEQUENTIAL);
+
+  // The output records the sort field and the first key of every block
+  // (a sort by keys is sorted by its first key if that one is ascending)
+  int index_field = (fieldNo == SORT_FIELD_KEYS) ? key_spec_leading_field(cmp_ctx) : fieldNo;
+  if (index_field >= 0) {
+    sparse_index_init(&index, index_field);
+    output_index = &index;
   }
 
-
-  for (int i = 0; i < buffers_needed_for_merge[current_merge]; i++) {
-    if ((current_merge == number_of_merges - 1) && (i == buffers_needed_for_merge[current_merge] - 1))
-      tot_blocks_in_group[i] = blocks_to_output - ((num_of_block_groups-1)*blocks_in_group);
-    else
-      tot_blocks_in_group[i] = blocks_in_group;
+  if (limit >= 0 && limit <= (bufferSize - 2)*sr_records_per_block()) {
+    // The output fits in memory, a single scan keeps the smallest records
+    // (the heap is never spilled, a larger limit is a sort through the temp file)
+    ret = top_k(input_fileDesc, output_fileDesc, cmp, cmp_ctx, options->normalize_keys, limit,
+                buff_blocks, output_index);
   }
-
-
-  // Take the first block from the first bufferSize-1 block groups USING ONLY THE BUFFERS NEEDED FOR MERGE
-  for (int i = 0; i < buffers_needed_for_merge[current_merge]; i++) {
-    block_index[i] = blocks_to_output*fl + blocks_in_group*(i+j);
-    CHK_BF_ERR(BF_GetBlock(temp_fileDesc, block_index[i], buff_blocks[i]));
-    buff_data[i] = BF_Block_GetData(buff_blocks[i]);
+  else if (limit < 0 && options->reduce == SR_REDUCE_NONE &&
+           options->run_generation == SR_RUNS_LOAD_AND_SORT &&
+           input_block_num - 1 <= bufferSize - 1) {
+    // The whole input is a single group, sort it straight into the output file
+    // (a reduced group would leave empty blocks in it, so it goes through the temp file)
+    RunList runs;
+    run_list_init(&runs);
+    ret = load_and_sort_runs(input_fileDesc, output_fileDesc, fieldNo, cmp, cmp_ctx,
+                             options->normalize_keys, bufferSize, options->group_sort, 1,
+                             NULL, buff_blocks, output_index, &runs);
+    run_list_destroy(&runs);
   }
-
-  // For output buffer
-  block_index[bufferSize-1] = 1;
-  CHK_BF_ERR(BF_GetBlock(output_fileDesc, block_index[bufferSize-1], buff_blocks[bufferSize-1]));
-  buff_data[bufferSize-1] = BF_Block_GetData(buff_blocks[bufferSize-1]);
-
-
-  memcpy(&tot_recs_in_block[bufferSize-1], buff_data[bufferSize-1], sizeof(int));
-  block_index_in_group[bufferSize-1] = 0;
-  rec_index_in_block[bufferSize-1] = 0;
-  record_data[bufferSize-1] = buff_data[bufferSize-1] + sizeof(int);
-
-
-
-  //merge start//
-
-  // Initialization for normal buffers may be fewer than bufferSize-1!!!!
-  for (int i = 0; i < buffers_needed_for_merge[current_merge]; i++) {
-    memcpy(&tot_recs_in_block[i], buff_data[i], sizeof(int));
-    block_index_in_group[i] = 0;
-    rec_index_in_block[i] = 0;
-    record_data[i] = buff_data[i] + sizeof(int);
+  else {
+    ret = sort_through_temp(input_fileDesc, output_fileDesc, fieldNo, cmp, cmp_ctx, bufferSize,
+                            limit, options, buff_blocks, output_index);
   }
+  if (ret == SR_OK && output_index != NULL)
+    ret = sparse_index_write(output_index, output_fileDesc, buff_blocks[0]);
 
-  while(block_index[bufferSize-1] <= blocks_to_output) {
-    // Find min record value
-    int min_record_i = -1;
-    for (int buff_i = 0; buff_i < buffers_needed_for_merge[current_merge]; buff_i++) {
-      if (block_index_in_group[buff_i] < tot_blocks_in_group[buff_i]) {
-
-        if(min_record_i == -1 ||
-            record_cmp(fieldNo, record_data[buff_i][rec_index_in_block[buff_i]],
-                      record_data[min_record_i][rec_index_in_block[min_record_i]]) < 0){
-
-          min_record_i = buff_i;
-        }
-      }
-    }
+cleanup:
+  if (output_index != NULL)
+    sparse_index_destroy(output_index);
+  // Destroy blocks
+  for (int i=0; i < bufferSize; i++)
+    BF_Block_Destroy(&buff_blocks[i]);
+  // Close files
+  if (output_fileDesc >= 0 && SR_CloseFile(output_fileDesc) != SR_OK)
+    ret = SR_ERROR;
+  if (input_fileDesc >= 0 && SR_CloseFile(input_fileDesc) != SR_OK)
+    ret = SR_ERROR;
+  return ret;
+}
 
+SR_ErrorCode SR_SortedFileWithOptions(
+  const char* input_filename,
+  const char* output_filename,
+  int fieldNo,
+  int bufferSize,
+  const SR_SortOptions* options
+) {
+  SR_SortOptions default_options;
+  if (options == NULL) {
+    SR_SortOptions_Init(&default_options);
+    options = &default_options;
+  }
 
-    // Copy the whole record to bufferSize-1 (output block)
-    record_data[bufferSize-1][rec_index_in_block[bufferSize-1]]
-      = record_data[min_record_i][rec_index_in_block[min_record_i]];
+  // Check for invalid fieldNo
+  if (fieldNo < 0 || fieldNo > 3)
+    return SR_ERROR;
+  // Duplicates are only next to each other if the other fields break the ties
+  if (options->reduce == SR_REDUCE_DISTINCT) {
+    SR_SortKey key = { fieldNo, 0 };
+    return SR_SortedFileByKeys(input_filename, output_filename, &key, 1, bufferSize, options);
+  }
+  // The count is kept in the id, so the records cannot be grouped by it
+  if (options->reduce == SR_REDUCE_COUNT && fieldNo == 0)
+    return SR_ERROR;
+  // Records are normalized in part 1, so part 2 can also use the SIMD comparator
+  RecordCmp cmp = options->normalize_keys ? record_comparator_normalized(fieldNo)
+                                          : record_comparator(fieldNo);
+  return sorted_file(input_filename, output_filename, fieldNo, cmp, NULL, bufferSize, -1,
+                     options);
+}
 
-    // We passed one record from one buffer
-    rec_index_in_block[min_record_i]++;
-    // If there are no other records in the block of the min record, move to the next block
-    if (rec_index_in_block[min_record_i] == tot_recs_in_block[min_record_i]) {
-      // Unpin previous block
-      CHK_BF_ERR(BF_UnpinBlock(buff_blocks[min_record_i]));
-      // Get next block
-      block_index[min_record_i]++;
-      block_index_in_group[min_record_i]++;
+SR_ErrorCode SR_SortedFileTopK(
+  const char* input_filename,
+  const char* output_filename,
+  int fieldNo,
+  int k,
+  int bufferSize,
+  const SR_SortOptions* options
+) {
+  SR_SortOptions default_options;
+  if (options == NULL) {
+    SR_SortOptions_Init(&default_options);
+    options = &default_options;
+  }
 
-      // If not, do not get next block (instead search in the other buffers)
-      if (block_index_in_group[min_record_i] < tot_blocks_in_group[min_record_i]) {
-        CHK_BF_ERR(BF_GetBlock(temp_fileDesc, block_index[min_record_i], buff_blocks[min_record_i]));
+  // Check for invalid fieldNo and k, the top records are not reduced
+  if (fieldNo < 0 || fieldNo > 3 || k < 0 || options->reduce != SR_REDUCE_NONE)
+    return SR_ERROR;
+  RecordCmp cmp = options->normalize_keys ? record_comparator_normalized(fieldNo)
+                                          : record_comparator(fieldNo);
+  return sorted_file(input_filename, output_filename, fieldNo, cmp, NULL, bufferSize, k,
+                     options);
+}
 
-        rec_index_in_block[min_record_i] = 0;
+SR_ErrorCode SR_SortedFileByKeys(
+  const char* input_filename,
+  const char* output_filename,
+  const SR_SortKey* keys,
+  int key_num,
+  int bufferSize,
+  const SR_SortOptions* options
+) {
+  SR_SortOptions default_options;
+  if (options == NULL) {
+    SR_SortOptions_Init(&default_options);
+    options = &default_options;
+  }
 
-        buff_data[min_record_i] = BF_Block_GetData(buff_blocks[min_record_i]);
-        memcpy(&tot_recs_in_block[min_record_i], buff_data[min_record_i], sizeof(int));
-        record_data[min_record_i] = buff_data[min_record_i] + sizeof(int);
-      }
-    }
-    // We passed one record in the output block
-    rec_index_in_block[bufferSize-1]++;
-    // Check if output buffer is full (get next block)
-    if (rec_index_in_block[bufferSize-1] == tot_recs_in_block[bufferSize-1]) {
-      // Dirty and Unpin previous block
-      BF_Block_SetDirty(buff_blocks[bufferSize-1]);
-      CHK_BF_ERR(BF_UnpinBlock(buff_blocks[bufferSize-1]));
-
-      // Get next block
-      block_index[bufferSize-1]++;
-      block_index_in_group[bufferSize-1]++;//we passed one block
-      // Only if its in bounds
-      if (block_index[bufferSize-1] <= blocks_to_output) {
-        CHK_BF_ERR(BF_GetBlock(output_fileDesc, block_index[bufferSize-1], buff_blocks[bufferSize-1]));
-
-        rec_index_in_block[bufferSize-1] = 0;
-
-        buff_data[bufferSize-1] = BF_Block_GetData(buff_blocks[bufferSize-1]);
-        memcpy(&tot_recs_in_block[bufferSize-1], buff_data[bufferSize-1], sizeof(int));
-        record_data[bufferSize-1] = buff_data[bufferSize-1] + sizeof(int);
+  // Check for invalid keys, every field may be used once
+  if (key_num < 1 || key_num > 4)
+    return SR_ERROR;
+  int used_fields = 0;
+  for (int i = 0; i < key_num; i++) {
+    if (keys[i].fieldNo < 0 || keys[i].fieldNo > 3 || (used_fields & (1 << keys[i].fieldNo)))
+      return SR_ERROR;
+    used_fields |= 1 << keys[i].fieldNo;
+  }
+  if (options->reduce == SR_REDUCE_COUNT && (used_fields & 1))
+    return SR_ERROR;
+  // Duplicates are only next to each other if every field is a key, the
+  // fields that are not are added as ascending keys
+  SR_SortKey all_keys[4];
+  if (options->reduce == SR_REDUCE_DISTINCT) {
+    memcpy(all_keys, keys, key_num * sizeof(SR_SortKey));
+    for (int fieldNo = 0; fieldNo <= 3; fieldNo++) {
+      if (!(used_fields & (1 << fieldNo))) {
+        all_keys[key_num].fieldNo = fieldNo;
+        all_keys[key_num].descending = 0;
+        key_num++;
       }
     }
+    keys = all_keys;
   }
 
-  // End program
-  // Destroy blocks
-  for (int i=0; i < bufferSize; i++)
-    BF_Block_Destroy(&buff_blocks[i]);
-  // Close files
-  SR_CloseFile(input_fileDesc);
-  CHK_BF_ERR(BF_CloseFile(temp_fileDesc));
-  SR_CloseFile(output_fileDesc);
-  // Delete temp file
-  remove(temp_filename);
-  return SR_OK;
+  // A single ascending key is a plain sort by its field
+  if (key_num == 1 && !keys[0].descending)
+    return SR_SortedFileWithOptions(input_filename, output_filename, keys[0].fieldNo,
+                                    bufferSize, options);
+
+  // The keys are the context of the comparator, so every sort has its own
+  KeySpec spec;
+  key_spec_init(&spec, keys, key_num, options->normalize_keys);
+  return sorted_file(input_filename, output_filename, SORT_FIELD_KEYS, record_cmp_keys, &spec,
+                     bufferSize, -1, options);
 }
 
 
 SR_ErrorCode SR_PrintAllEntries(int fileDesc) {
+  // The scan reads every block once, its blocks are replaced first
+  BF_AccessHint hint = BF_HINT_NORMAL;
+  if (BF_GetFileHint != NULL)
+    CHK_BF_ERR(BF_GetFileHint(fileDesc, &hint));
+  set_file_hint(fileDesc, BF_HINT_SEQUENTIAL);
+
   BF_Block *block;
   BF_Block_Init(&block);
-  Record record;
   // Get number of blocks
   int block_num;
   CHK_BF_ERR(BF_GetBlockCounter(fileDesc, &block_num));
@@ -719,18 +915,190 @@ SR_ErrorCode SR_PrintAllEntries(int fileDesc) {
     // Get number of records in current block
     int rec_num = 0;
     memcpy(&rec_num, block_data, sizeof(int));
-    // For each record in the block, get and print record
+    // For each record in the block, print it where it is in the block
+    const Record* records = (const Record*)(block_data + sizeof(int));
     for (int j = 0; j < rec_num; j++) {
-      memcpy(&record, block_data + sizeof(int) + j*sizeof(Record),
-          sizeof(Record));
-          printf("%d,\"%s\",\"%s\",\"%s\"\n",
-          record.id, record.name, record.surname, record.city);
+      printf("%d,\"%s\",\"%s\",\"%s\"\n",
+          records[j].id, records[j].name, records[j].surname, records[j].city);
     }
     // Unpin block
     CHK_BF_ERR(BF_UnpinBlock(block));
   }
 
-  // Destroy block
+  // Destroy block and give the file its hint back
+  BF_Block_Destroy(&block);
+  set_file_hint(fileDesc, hint);
+  return SR_OK;
+}
+
+SR_ErrorCode SR_GetSortField(int fileDesc, int *fieldNo) {
+  BF_Block* block;
+  BF_Block_Init(&block);
+  SparseIndexInfo info;
+  SR_ErrorCode ret = sparse_index_read_info(fileDesc, block, &info);
+  BF_Block_Destroy(&block);
+  if (ret == SR_OK)
+    *fieldNo = info.fieldNo;
+  return ret;
+}
+
+SR_ErrorCode SR_RangeScan(
+  int fileDesc,
+  int fieldNo,
+  const Record *low,
+  const Record *high,
+  SR_RecordCallback callback,
+  void *arg
+) {
+  if (fieldNo < 0 || fieldNo > 3)
+    return SR_ERROR;
+  RecordCmp cmp = record_comparator(fieldNo);
+
+  SR_ErrorCode ret = SR_ERROR;
+  BF_Block *block;
+  BF_Block_Init(&block);
+  int block_num;
+  CHK_BF_CLEANUP(BF_GetBlockCounter(fileDesc, &block_num));
+
+  // A file sorted by the field is searched from the block where low may start,
+  // and read until the first record after high. Any other file is read whole
+  SparseIndexInfo info;
+  if (sparse_index_read_info(fileDesc, block, &info) != SR_OK)
+    goto cleanup;
+  const int sorted = (info.fieldNo == fieldNo);
+  int first_block = 1;
+  if (sorted) {
+    block_num = info.first_block;
+    if (low != NULL && sparse_index_find(fileDesc, block, &info, low, &first_block) != SR_OK)
+      goto cleanup;
+  }
+
+  int done = 0;
+  for (int i = first_block; i < block_num && !done; i++) {
+    CHK_BF_CLEANUP(BF_GetBlock(fileDesc, i, block));
+    char* block_data = BF_Block_GetData(block);
+    int rec_num = 0;
+    memcpy(&rec_num, block_data, sizeof(int));
+    const Record* records = (const Record*)(block_data + sizeof(int));
+    for (int j = 0; j < rec_num; j++) {
+      if (low != NULL && cmp(&records[j], low, NULL) < 0)
+        continue;
+      if (high != NULL && cmp(&records[j], high, NULL) > 0) {
+        if (sorted) {
+          done = 1;
+          break;
+        }
+        continue;
+      }
+      callback(&records[j], arg);
+    }
+    CHK_BF_CLEANUP(BF_UnpinBlock(block));
+  }
+  ret = SR_OK;
+
+cleanup:
   BF_Block_Destroy(&block);
+  return ret;
+}
+
+SR_ErrorCode SR_Search(
+  int fileDesc,
+  int fieldNo,
+  const Record *key,
+  SR_RecordCallback callback,
+  void *arg
+) {
+  return SR_RangeScan(fileDesc, fieldNo, key, key, callback, arg);
+}
+
+// Opens a file sorted by fieldNo for a join and finds where its data blocks end
+// On error the file is closed again and *fileDesc is not set
+static SR_ErrorCode open_join_input(const char* filename, int fieldNo, BF_Block* block,
+                                    int* fileDesc, int* end_block) {
+  int tmp_fd;
+  if (SR_OpenFile(filename, &tmp_fd) != SR_OK)
+    return SR_ERROR;
+  SparseIndexInfo info;
+  if (sparse_index_read_info(tmp_fd, block, &info) != SR_OK) {
+    SR_CloseFile(tmp_fd);
+    return SR_ERROR;
+  }
+  if (info.fieldNo != fieldNo) {
+    printf("Error: File %s is not sorted by field %d\n", filename, fieldNo);
+    SR_CloseFile(tmp_fd);
+    return SR_ERROR;
+  }
+  *fileDesc = tmp_fd;
+  *end_block = info.first_block;
   return SR_OK;
 }
+
+SR_ErrorCode SR_MergeJoin(
+  const char* left_filename,
+  const char* right_filename,
+  int fieldNo,
+  const char* output_filename,
+  SR_JoinCallback callback,
+  void* arg
+) {
+  if (fieldNo < 0 || fieldNo > 3)
+    return SR_ERROR;
+  if (output_filename == NULL && callback == NULL)
+    return SR_ERROR;
+
+  // Three blocks for the readers and one for the output
+  // Everything acquired below is released at cleanup, on success and on error
+  BF_Block* blocks[4];
+  for (int i = 0; i < 4; i++)
+    BF_Block_Init(&blocks[i]);
+  SR_ErrorCode ret = SR_ERROR;
+  int left_fileDesc = -1, left_end_block;
+  int right_fileDesc = -1, right_end_block;
+  int output_fileDesc = -1;
+
+  // A file joined with itself is opened once
+  if (open_join_input(left_filename, fieldNo, blocks[0], &left_fileDesc, &left_end_block) != SR_OK)
+    goto cleanup;
+  if (strcmp(left_filename, right_filename) == 0) {
+    right_fileDesc = left_fileDesc;
+    right_end_block = left_end_block;
+  }
+  else if (open_join_input(right_filename, fieldNo, blocks[0], &right_fileDesc,
+                           &right_end_block) != SR_OK) {
+    goto cleanup;
+  }
+
+  // The joined pairs are written as two consecutive records
+  BlockWriter writer;
+  if (output_filename != NULL) {
+    if (SR_CreateFile(output_filename) != SR_OK)
+      goto cleanup;
+    if (SR_OpenFile(output_filename, &output_fileDesc) != SR_OK)
+      goto cleanup;
+    set_file_hint(output_fileDesc, BF_HINT_SEQUENTIAL);
+    block_writer_open(&writer, output_fileDesc, blocks[3], 1, 1);
+  }
+
+  ret = merge_join(left_fileDesc, left_end_block, right_fileDesc, right_end_block,
+                   record_comparator(fieldNo), blocks,
+                   (output_filename != NULL) ? &writer : NULL, callback, arg);
+  if (output_filename != NULL) {
+    if (ret == SR_OK)
+      ret = block_writer_close(&writer);
+    if (ret != SR_OK)
+      block_writer_abort(&writer);
+  }
+
+cleanup:
+  for (int i = 0; i < 4; i++)
+    BF_Block_Destroy(&blocks[i]);
+  // Close files
+  if (output_fileDesc >= 0 && SR_CloseFile(output_fileDesc) != SR_OK)
+    ret = SR_ERROR;
+  if (right_fileDesc >= 0 && right_fileDesc != left_fileDesc &&
+      SR_CloseFile(right_fileDesc) != SR_OK)
+    ret = SR_ERROR;
+  if (left_fileDesc >= 0 && SR_CloseFile(left_fileDesc) != SR_OK)
+    ret = SR_ERROR;
+  return ret;
+}
@@ -0,0 +1,186 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "sparse_index.h"
+
+#define CHK_BF_ERR(call)      \
+  {                           \
+    BF_ErrorCode code = call; \
+    if (code != BF_OK) {      \
+      BF_PrintError(code);    \
+      return SR_ERROR;        \
+    }                         \
+  }
+
+// Marks the index information in the first block (see SF_INDEX_OFFSET)
+static const char index_marker[4] = ".ix";
+
+// Keys that fit in an index block after the record counter
+static int keys_per_block(size_t key_size) {
+  return (int)((sr_block_size() - sizeof(int)) / key_size);
+}
+
+void sparse_index_init(SparseIndex* index, int fieldNo) {
+  index->fieldNo = fieldNo;
+  if (fieldNo == 0) {
+    index->key_offset = offsetof(Record, id);
+    index->key_size = sizeof(int);
+  }
+  else {
+    index->key_offset = string_field_offset(fieldNo);
+    index->key_size = string_field_size(fieldNo);
+  }
+  index->keys = NULL;
+  index->block_num = 0;
+  index->capacity = 0;
+}
+
+void sparse_index_destroy(SparseIndex* index) {
+  free(index->keys);
+  index->keys = NULL;
+  index->block_num = 0;
+  index->capacity = 0;
+}
+
+// Makes room for the keys of block_num data blocks, so threads that write
+// different blocks can set their keys at the same time
+// Returns 0 on success, -1 if memory could not be allocated
+int sparse_index_reserve(SparseIndex* index, int block_num) {
+  if (block_num > index->capacity) {
+    int capacity = (index->capacity == 0) ? 64 : index->capacity;
+    while (capacity < block_num)
+      capacity *= 2;
+    char* keys = realloc(index->keys, (size_t)capacity * index->key_size);
+    if (keys == NULL)
+      return -1;
+    index->keys = keys;
+    index->capacity = capacity;
+  }
+  if (block_num > index->block_num)
+    index->block_num = block_num;
+  return 0;
+}
+
+// Sets the key of data block block (1 and on) to the field of record,
+// zero padded after the '\0' of a string field
+// Returns 0 on success, -1 if memory could not be allocated
+int sparse_index_set(SparseIndex* index, int block, const Record* record) {
+  if (block > index->block_num && sparse_index_reserve(index, block) != 0)
+    return -1;
+  char* key = index->keys + (size_t)(block - 1) * index->key_size;
+  const char* field = (const char*)record + index->key_offset;
+  if (index->fieldNo == 0) {
+    memcpy(key, field, index->key_size);
+  }
+  else {
+    size_t len = strnlen(field, index->key_size);
+    memcpy(key, field, len);
+    memset(key + len, 0, index->key_size - len);
+  }
+  return 0;
+}
+
+// Appends the index blocks to the file, whose blocks 1 and on are the data
+// blocks of the index, and records the index in the first block
+SR_ErrorCode sparse_index_write(const SparseIndex* index, int fileDesc, BF_Block* block) {
+  int first_block;
+  CHK_BF_ERR(BF_GetBlockCounter(fileDesc, &first_block));
+  // Without the key of every data block the file is left without an index
+  if (index->block_num != first_block - 1)
+    return SR_OK;
+
+  const int per_block = keys_per_block(index->key_size);
+  int block_num = 0;
+  for (int i = 0; i < index->block_num; i += per_block) {
+    int key_num = index->block_num - i;
+    if (key_num > per_block)
+      key_num = per_block;
+    CHK_BF_ERR(BF_AllocateBlock(fileDesc, block));
+    char* data = BF_Block_GetData(block);
+    int rec_num = 0;
+    memcpy(data, &rec_num, sizeof(int));
+    memcpy(data + sizeof(int), index->keys + (size_t)i * index->key_size,
+           (size_t)key_num * index->key_size);
+    BF_Block_SetDirty(block);
+    CHK_BF_ERR(BF_UnpinBlock(block));
+    block_num++;
+  }
+
+  // Marker, sort field, first index block and index blocks
+  CHK_BF_ERR(BF_GetBlock(fileDesc, 0, block));
+  char* data = BF_Block_GetData(block) + SF_INDEX_OFFSET;
+  int header[3] = { index->fieldNo, first_block, block_num };
+  memcpy(data, index_marker, sizeof(index_marker));
+  memcpy(data + sizeof(index_marker), header, sizeof(header));
+  BF_Block_SetDirty(block);
+  CHK_BF_ERR(BF_UnpinBlock(block));
+  return SR_OK;
+}
+
+// Reads the index information of the file. The index is only valid if the
+// file still ends with it and its last block has no records, otherwise
+// records were inserted after the sort and info->fieldNo is set to -1
+SR_ErrorCode sparse_index_read_info(int fileDesc, BF_Block* block, SparseIndexInfo* info) {
+  info->fieldNo = -1;
+  int file_block_num;
+  CHK_BF_ERR(BF_GetBlockCounter(fileDesc, &file_block_num));
+
+  CHK_BF_ERR(BF_GetBlock(fileDesc, 0, block));
+  const char* data = BF_Block_GetData(block) + SF_INDEX_OFFSET;
+  int header[3];
+  int marked = (memcmp(data, index_marker, sizeof(index_marker)) == 0);
+  memcpy(header, data + sizeof(index_marker), sizeof(header));
+  CHK_BF_ERR(BF_UnpinBlock(block));
+  if (!marked || header[0] < 0 || header[0] > 3 || header[1] < 1 ||
+      header[1] + header[2] != file_block_num)
+    return SR_OK;
+
+  if (header[2] > 0) {
+    CHK_BF_ERR(BF_GetBlock(fileDesc, file_block_num - 1, block));
+    int rec_num;
+    memcpy(&rec_num, BF_Block_GetData(block), sizeof(int));
+    CHK_BF_ERR(BF_UnpinBlock(block));
+    if (rec_num != 0)
+      return SR_OK;
+  }
+  info->fieldNo = header[0];
+  info->first_block = header[1];
+  info->block_num = header[2];
+  return SR_OK;
+}
+
+// Binary search of the index for the first data block that may hold a record
+// with a field not smaller than the field of key: the last block whose first
+// key is smaller than it (equal keys may start in it), or block 1
+SR_ErrorCode sparse_index_find(int fileDesc, BF_Block* block, const SparseIndexInfo* info,
+                               const Record* key, int* first_block) {
+  SparseIndex index;
+  sparse_index_init(&index, info->fieldNo);
+  const int per_block = keys_per_block(index.key_size);
+  RecordCmp cmp = record_comparator(info->fieldNo);
+
+  // Every probe reads one index block and compares its key as a record field
+  Record probe;
+  memset(&probe, 0, sizeof(Record));
+  int low = 0;
+  int high = info->first_block - 1;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    CHK_BF_ERR(BF_GetBlock(fileDesc, info->first_block + mid / per_block, block));
+    const char* data = BF_Block_GetData(block) + sizeof(int);
+    memcpy((char*)&probe + index.key_offset, data + (size_t)(mid % per_block) * index.key_size,
+           index.key_size);
+    CHK_BF_ERR(BF_UnpinBlock(block));
+    if (cmp(&probe, key, NULL) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  *first_block = (low > 0) ? low : 1;
+  return SR_OK;
+}
@@ -1,67 +1,239 @@
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "sort_file.h"
+#include "sr_utils.h"
 
-// Compares records by comparing a specific field (input fieldNo)
-// Output is similar to strcmp (only with -2 output for input errors)
-int record_cmp(int fieldNo, Record record1, Record record2) {
-  // Only for comparing the id of the records
-  if (fieldNo == 0) {
-    if (record1.id < record2.id)
-      return -1;
-    else if (record1.id > record2.id)
-      return 1;
-    else
-      return 0;
+// Comparators of every sort field, output is similar to strcmp
+// They take the records by pointer and are picked once per sort with
+// record_comparator, so the hot loops do not branch on the field
+static int record_cmp_id(const Record* record1, const Record* record2, const void* ctx) {
+  return (record1->id > record2->id) - (record1->id < record2->id);
+}
+
+// Only the sign of strcmp is used, so it is called once
+#define DEFINE_STRING_CMP(cmp_name, field)                          \
+  static int cmp_name(const Record* record1, const Record* record2, \
+                      const void* ctx) {                            \
+    return strcmp(record1->field, record2->field);                  \
   }
-  else if (fieldNo <= 3) {
-    char* string_field1;
-    char* string_field2;
-    // Get the string that we want to compare (depends on fieldNo)
-    if (fieldNo == 1) {
-        string_field1 = record1.name;
-        string_field2 = record2.name;
-    }
-    else if (fieldNo == 2) {
-        string_field1 = record1.surname;
-        string_field2 = record2.surname;
+
+DEFINE_STRING_CMP(record_cmp_name, name)
+DEFINE_STRING_CMP(record_cmp_surname, surname)
+DEFINE_STRING_CMP(record_cmp_city, city)
+
+// Comparators of normalized records (see record_normalize)
+// The string fields are zero padded, so a field is ordered like its first
+// differing byte and the whole field can be compared with SSE2 instead of a
+// byte by byte strcmp loop. The 16 byte loads never leave the record: name
+// takes one load (masked to its 15 bytes) and surname and city take two
+// overlapping loads each
+#ifdef __SSE2__
+static inline int cmp_16_bytes(const char* a, const char* b, unsigned int valid_mask) {
+  __m128i va = _mm_loadu_si128((const __m128i*)a);
+  __m128i vb = _mm_loadu_si128((const __m128i*)b);
+  unsigned int diff = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & valid_mask;
+  if (diff == 0)
+    return 0;
+  int i = __builtin_ctz(diff);
+  return (int)(unsigned char)a[i] - (int)(unsigned char)b[i];
+}
+
+static int record_cmp_name_normalized(const Record* record1, const Record* record2,
+                                      const void* ctx) {
+  return cmp_16_bytes(record1->name, record2->name, 0x7FFF);
+}
+
+#define DEFINE_WIDE_STRING_CMP(cmp_name, field)                       \
+  static int cmp_name(const Record* record1, const Record* record2, \
+                      const void* ctx) {                            \
+    int cmp = cmp_16_bytes(record1->field, record2->field, 0xFFFF);   \
+    if (cmp != 0)                                                   \
+      return cmp;                                                   \
+    return cmp_16_bytes(record1->field + 4, record2->field + 4, 0xFFFF); \
+  }
+
+DEFINE_WIDE_STRING_CMP(record_cmp_surname_normalized, surname)
+DEFINE_WIDE_STRING_CMP(record_cmp_city_normalized, city)
+#else
+#define DEFINE_PADDED_STRING_CMP(cmp_name, field)                     \
+  static int cmp_name(const Record* record1, const Record* record2, \
+                      const void* ctx) {                            \
+    return memcmp(record1->field, record2->field, sizeof(record1->field)); \
+  }
+
+DEFINE_PADDED_STRING_CMP(record_cmp_name_normalized, name)
+DEFINE_PADDED_STRING_CMP(record_cmp_surname_normalized, surname)
+DEFINE_PADDED_STRING_CMP(record_cmp_city_normalized, city)
+#endif
+
+// Returns the comparator of a field (input fieldNo), NULL for a wrong fieldNo
+RecordCmp record_comparator(int fieldNo) {
+  static const RecordCmp comparators[] = {
+    record_cmp_id,
+    record_cmp_name,
+    record_cmp_surname,
+    record_cmp_city
+  };
+  if (fieldNo < 0 || fieldNo > 3)
+    return NULL;
+  return comparators[fieldNo];
+}
+
+// Same as record_comparator, but the records must have been normalized
+RecordCmp record_comparator_normalized(int fieldNo) {
+  static const RecordCmp comparators[] = {
+    record_cmp_id,
+    record_cmp_name_normalized,
+    record_cmp_surname_normalized,
+    record_cmp_city_normalized
+  };
+  if (fieldNo < 0 || fieldNo > 3)
+    return NULL;
+  return comparators[fieldNo];
+}
+
+// Keeps the keys (at most 4, checked by the caller) in spec
+// If normalized is set the records must have been normalized
+void key_spec_init(KeySpec* spec, const SR_SortKey* keys, int key_num, int normalized) {
+  spec->key_num = key_num;
+  for (int i = 0; i < key_num; i++) {
+    spec->fields[i] = keys[i].fieldNo;
+    spec->descending[i] = keys[i].descending;
+    spec->cmps[i] = normalized ? record_comparator_normalized(keys[i].fieldNo)
+                               : record_comparator(keys[i].fieldNo);
+  }
+}
+
+// Returns the field the records are sorted by when sorted by the keys, which is
+// the first key if it is ascending, or -1
+int key_spec_leading_field(const KeySpec* spec) {
+  if (spec->key_num == 0 || spec->descending[0])
+    return -1;
+  return spec->fields[0];
+}
+
+// Compares two records by every key of spec (a KeySpec) in order, the first
+// key that differs decides (with its sign flipped if the key is descending)
+int record_cmp_keys(const Record* record1, const Record* record2, const void* spec) {
+  const KeySpec* keys = spec;
+  for (int i = 0; i < keys->key_num; i++) {
+    int cmp = keys->cmps[i](record1, record2, NULL);
+    if (cmp != 0)
+      return keys->descending[i] ? (cmp < 0) - (cmp > 0) : cmp;
+  }
+  return 0;
+}
+
+// First 8 bytes of the composite key of a record: the keys one after the
+// other, the id sign-flipped in big endian order and the string fields zero
+// padded after the '\0', with the bytes of descending keys inverted. Comparing
+// prefixes as unsigned integers orders them like record_cmp_keys
+unsigned long long record_keys_prefix(const Record* record, const KeySpec* spec) {
+  unsigned long long prefix = 0;
+  int bytes = 0;
+  for (int i = 0; i < spec->key_num && bytes < 8; i++) {
+    unsigned char flip = spec->descending[i] ? 0xFF : 0;
+    int fieldNo = spec->fields[i];
+    if (fieldNo == 0) {
+      unsigned int id = (unsigned int)record->id ^ 0x80000000u;
+      for (int shift = 24; shift >= 0 && bytes < 8; shift -= 8, bytes++)
+        prefix = (prefix << 8) | (((id >> shift) & 0xFF) ^ flip);
     }
-    else if (fieldNo == 3) {
-        string_field1 = record1.city;
-        string_field2 = record2.city;
+    else {
+      const char* field = (const char*)record + string_field_offset(fieldNo);
+      size_t size = string_field_size(fieldNo);
+      int ended = 0;
+      for (size_t j = 0; j < size && bytes < 8; j++, bytes++) {
+        if (field[j] == '\0')
+          ended = 1;
+        unsigned char c = ended ? 0 : (unsigned char)field[j];
+        prefix = (prefix << 8) | (unsigned char)(c ^ flip);
+      }
     }
-    // Then compare the two strings
-    if (strcmp(string_field1, string_field2) < 0)
-      return -1;
-    else if (strcmp(string_field1, string_field2) > 0)
-      return 1;
-    else
-      return 0;
   }
-  // In case of wrong fieldNo input
+  return prefix << (8 * (8 - bytes));
+}
+
+// Fills every string field of the record with zeros after its '\0'
+void record_normalize(Record* record) {
+  for (int fieldNo = 1; fieldNo <= 3; fieldNo++) {
+    char* field = (char*)record + string_field_offset(fieldNo);
+    size_t size = string_field_size(fieldNo);
+    size_t len = strnlen(field, size);
+    memset(field + len, 0, size - len);
+  }
+}
+
+// Returns the offset of a string field (fieldNo 1 to 3) in the Record struct
+size_t string_field_offset(int fieldNo) {
+  if (fieldNo == 1)
+    return offsetof(Record, name);
+  else if (fieldNo == 2)
+    return offsetof(Record, surname);
   else
-    return -2;
+    return offsetof(Record, city);
 }
 
-// Function that returns the nth (input) record from an array of blocks (buffers)
-// If n is greater than the number of records in a block, then go to the next one in the array
-// N will never be out of bounds (cause quicksort)
-Record* get_nth_record(char** buffer_data, int n) {
-    int buffer_i = 0;
-    int found = 0;
-    // Find the block where the record is, while making n in-bounds for that buffer
-    while (!found) {
-        int rec_number = 0; // H MPORW KAI = (int*)*buffer_data[buffer_i] ISWS KALITERO
-        memcpy(&rec_number, buffer_data[buffer_i], sizeof(int));
-        if (n >= rec_number) {
-            n = n - rec_number;
-            buffer_i++;
-        }
-        else
-            found = 1;
+// Returns the size of a string field (fieldNo 1 to 3) in the Record struct
+size_t string_field_size(int fieldNo) {
+  if (fieldNo == 1)
+    return sizeof(((Record*)0)->name);
+  else if (fieldNo == 2)
+    return sizeof(((Record*)0)->surname);
+  else
+    return sizeof(((Record*)0)->city);
+}
+
+// Prepares the addressing of the records of block_num blocks (buffer_data)
+// Returns the total number of records, or -1 if memory could not be allocated
+int record_addr_init(RecordAddr* addr, char** buffer_data, int block_num) {
+    addr->buffer_data = buffer_data;
+    addr->recs_per_block = 0;
+    addr->table = NULL;
+
+    int tot_records = 0;
+    int uniform = 1;
+    int first_rec_num = 0;
+    for (int i = 0; i < block_num; i++) {
+        int rec_num = 0;
+        memcpy(&rec_num, buffer_data[i], sizeof(int));
+        if (i == 0)
+            first_rec_num = rec_num;
+        // Only the last block may hold fewer records
+        else if (rec_num != first_rec_num && (i != block_num - 1 || rec_num > first_rec_num))
+            uniform = 0;
+        tot_records += rec_num;
+    }
+
+    // Fast path: the nth record is in block n / recs_per_block
+    if (uniform && first_rec_num > 0) {
+        addr->recs_per_block = first_rec_num;
+        return tot_records;
+    }
+
+    // Else keep a pointer to every record
+    addr->table = malloc((tot_records > 0 ? tot_records : 1) * sizeof(Record*));
+    if (addr->table == NULL)
+        return -1;
+    int n = 0;
+    for (int i = 0; i < block_num; i++) {
+        int rec_num = 0;
+        memcpy(&rec_num, buffer_data[i], sizeof(int));
+        Record* records = (Record*)(buffer_data[i] + sizeof(int));
+        for (int j = 0; j < rec_num; j++)
+            addr->table[n++] = &records[j];
     }
-    Record* data = buffer_data[buffer_i] + sizeof(int);
-    return &data[n];
+    return tot_records;
+}
+
+void record_addr_destroy(RecordAddr* addr) {
+    free(addr->table);
+    addr->table = NULL;
 }
 
 void record_swap(Record* a, Record* b) {
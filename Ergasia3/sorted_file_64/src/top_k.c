@@ -0,0 +1,123 @@
+#include <stdlib.h>
+
+#include "bf.h"
+#include "sort_file.h"
+#include "sr_utils.h"
+#include "run_io.h"
+#include "sparse_index.h"
+#include "top_k.h"
+
+/*
+ * Top-K selection (SR_SortedFileTopK when K records fit in memory)
+ * The input is streamed once through a max-heap of the K smallest records
+ * seen so far: a record smaller than the largest one of the heap replaces it,
+ * any other record is dropped at once. At the end the heap is sorted in place
+ * and its records are written to the output, so there is no temp file and no
+ * merge. The caller makes sure K records fit in bufferSize-2 blocks (one block
+ * is left for reading the input and one for writing the output).
+ */
+
+// Moves slot i of the heap down until no child holds a larger record
+static void sift_down(int* heap, int heap_size, int i, const Record* workspace, RecordCmp cmp,
+                      const void* cmp_ctx) {
+  int slot = heap[i];
+  while (2*i + 1 < heap_size) {
+    int child = 2*i + 1;
+    if (child + 1 < heap_size &&
+        cmp(&workspace[heap[child + 1]], &workspace[heap[child]], cmp_ctx) > 0)
+      child++;
+    if (cmp(&workspace[heap[child]], &workspace[slot], cmp_ctx) <= 0)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = slot;
+}
+
+// Writes the k smallest records of the input file (blocks 1 and on) into the
+// output file from block 1 onward, in the order of cmp (with its context cmp_ctx),
+// through buff_blocks[0] and buff_blocks[1]
+// If normalize is set the string fields are zero padded as they are read
+// If index is not NULL it gets the first record of every output block
+SR_ErrorCode top_k(int input_fileDesc, int output_fileDesc, RecordCmp cmp,
+                   const void* cmp_ctx, int normalize, int k, BF_Block** buff_blocks,
+                   SparseIndex* index) {
+  int input_block_num;
+  if (BF_GetBlockCounter(input_fileDesc, &input_block_num) != BF_OK)
+    return SR_ERROR;
+
+  Record* workspace = malloc((k > 0 ? k : 1) * sizeof(Record));
+  int* heap = malloc((k > 0 ? k : 1) * sizeof(int));
+  if (workspace == NULL || heap == NULL) {
+    free(workspace);
+    free(heap);
+    return SR_ERROR;
+  }
+
+  SR_ErrorCode ret = SR_OK;
+  RunReader reader;
+  if (run_reader_open(&reader, input_fileDesc, buff_blocks[0], 1, input_block_num, 0, -1) != SR_OK) {
+    free(workspace);
+    free(heap);
+    return SR_ERROR;
+  }
+
+  // The first k records fill the heap
+  int heap_size = 0;
+  Record* next;
+  while (k > 0 && (next = run_reader_current(&reader)) != NULL) {
+    if (heap_size < k) {
+      workspace[heap_size] = *next;
+      if (normalize)
+        record_normalize(&workspace[heap_size]);
+      heap[heap_size] = heap_size;
+      heap_size++;
+      if (heap_size == k)
+        for (int i = heap_size/2 - 1; i >= 0; i--)
+          sift_down(heap, heap_size, i, workspace, cmp, cmp_ctx);
+    }
+    // and every next record only gets in if it is smaller than the largest one
+    else {
+      Record incoming = *next;
+      if (normalize)
+        record_normalize(&incoming);
+      if (cmp(&incoming, &workspace[heap[0]], cmp_ctx) < 0) {
+        workspace[heap[0]] = incoming;
+        sift_down(heap, heap_size, 0, workspace, cmp, cmp_ctx);
+      }
+    }
+    if (run_reader_next(&reader) != SR_OK) {
+      ret = SR_ERROR;
+      break;
+    }
+  }
+  if (run_reader_close(&reader) != SR_OK)
+    ret = SR_ERROR;
+
+  // A heap that was never filled is built now, then sorted by moving the
+  // largest record to the end of the heap until it is empty
+  if (heap_size < k)
+    for (int i = heap_size/2 - 1; i >= 0; i--)
+      sift_down(heap, heap_size, i, workspace, cmp, cmp_ctx);
+  for (int n = heap_size - 1; n > 0; n--) {
+    int largest = heap[0];
+    heap[0] = heap[n];
+    heap[n] = largest;
+    sift_down(heap, n, 0, workspace, cmp, cmp_ctx);
+  }
+
+  BlockWriter writer;
+  block_writer_open(&writer, output_fileDesc, buff_blocks[1], 1, 1);
+  writer.index = index;
+  for (int i = 0; ret == SR_OK && i < heap_size; i++)
+    if (block_writer_put(&writer, &workspace[heap[i]]) != SR_OK)
+      ret = SR_ERROR;
+  if (ret == SR_OK)
+    ret = block_writer_close(&writer);
+  if (ret != SR_OK)
+    block_writer_abort(&writer);
+
+  free(workspace);
+  free(heap);
+  return ret;
+}